@@ -26,11 +26,20 @@
 #include <ppelib/ppelib-constants.h>
 
 #include "ppelib-error.h"
+#include "ppelib-internal.h"
 #include "export.h"
 #include "utils.h"
 
 {% from "print-field-macro.jinja" import print_field with context %}
 
+void serialize_certificate_header(const ppelib_certificate_t* certificate, uint8_t* buffer) {
+{%- for field in fields %}
+{%- if not ('format' in field and 'variable_size' in field.format) %}
+  write_{{field.pe_type}}(buffer + {{field.offset}}, certificate->{{field.name}});
+{%- endif %}
+{%- endfor %}
+}
+
 size_t serialize_certificate_table(const ppelib_certificate_table_t* certificate_table, uint8_t* buffer) {
   ppelib_reset_error();
 
@@ -56,7 +65,8 @@ size_t serialize_certificate_table(const ppelib_certificate_table_t* certificate
   return size + certificate_table->offset;
 }
 
-size_t deserialize_certificate_table(const uint8_t* buffer, ppelib_header_t* header, const size_t size, ppelib_certificate_table_t* certificate_table) {
+// buffer holds the file contents starting at file offset base.
+size_t deserialize_certificate_table(const uint8_t* buffer, size_t base, const size_t size, ppelib_header_t* header, ppelib_certificate_table_t* certificate_table, uint8_t borrow, const ppelib_file_t* pe) {
   ppelib_reset_error();
 
   size_t table_offset = header->data_directories[DIR_CERTIFICATE_TABLE].virtual_address;
@@ -69,6 +79,12 @@ size_t deserialize_certificate_table(const uint8_t* buffer, ppelib_header_t* hea
     return 0;
   }
 
+  if (table_offset < base) {
+    ppelib_set_error("Certificate table before start of buffer.");
+    return 0;
+  }
+  table_offset -= base;
+
   if (table_offset + table_size > size) {
     ppelib_set_error("Buffer too small for table.");
     return 0;
@@ -87,8 +103,13 @@ size_t deserialize_certificate_table(const uint8_t* buffer, ppelib_header_t* hea
     	return 0;
     }
 
+    ppelib_certificate_t* certificates = mem_realloc(pe, certificate_table->certificates, sizeof(ppelib_certificate_t) * (certificate_table->size + 1));
+    if (!certificates) {
+      ppelib_set_error("Unable to allocate certificate table");
+      return 0;
+    }
+    certificate_table->certificates = certificates;
     certificate_table->size++;
-    certificate_table->certificates = realloc(certificate_table->certificates, sizeof(ppelib_certificate_t) * certificate_table->size);
 
     {%- for field in fields %}
 {%- if 'format' in field and 'variable_size' in field.format %}
@@ -109,12 +130,16 @@ size_t deserialize_certificate_table(const uint8_t* buffer, ppelib_header_t* hea
       return 0;
     }
 
-    certificate_table->certificates[i].certificate = malloc(certificate_table->certificates[i].{{length_field}});
-    if (!certificate_table->certificates[i].certificate){
-      ppelib_set_error("Unable to allocate certificate");
-      return 0;
+    if (borrow) {
+      certificate_table->certificates[i].certificate = (uint8_t*)buffer + offset + 8;
+    } else {
+      certificate_table->certificates[i].certificate = mem_alloc(pe, certificate_table->certificates[i].{{length_field}});
+      if (!certificate_table->certificates[i].certificate){
+        ppelib_set_error("Unable to allocate certificate");
+        return 0;
+      }
+      memcpy(certificate_table->certificates[i].certificate, buffer + offset + 8, certificate_table->certificates[i].{{length_field}} - 8);
     }
-    memcpy(certificate_table->certificates[i].certificate, buffer + offset + 8, certificate_table->certificates[i].{{length_field}} - 8);
 
     offset = TO_NEAREST(offset + certificate_table->certificates[i].{{length_field}}, 8);
     if (offset < prev_offset) {
@@ -123,9 +148,9 @@ size_t deserialize_certificate_table(const uint8_t* buffer, ppelib_header_t* hea
     }
   }
 
-  certificate_table->offset = table_offset;
+  certificate_table->offset = table_offset + base;
 
-  return max_offset;
+  return max_offset + base;
 }
 
 EXPORT_SYM void ppelib_print_certificate_table(const ppelib_certificate_table_t* certificate_table) {
@@ -142,15 +167,15 @@ EXPORT_SYM void ppelib_print_certificate_table(const ppelib_certificate_table_t*
   }
 }
 
-void ppelib_free_certificate_table(ppelib_certificate_table_t* certificate_table) {
+void ppelib_free_certificate_table(const ppelib_file_t* pe, ppelib_certificate_table_t* certificate_table) {
 	if (!certificate_table->size) {
 		return;
 	}
 
 	for (size_t i = 0; i < certificate_table->size; ++i) {
-		free(certificate_table->certificates[i].certificate);
+		buffer_free(pe, certificate_table->certificates[i].certificate);
 	}
-	free(certificate_table->certificates);
+	mem_free(pe, certificate_table->certificates);
 
 	certificate_table->size = 0;
 }
@@ -23,6 +23,7 @@
 #include <ppelib/ppelib-constants.h>
 #include <ppelib/ppelib-header.h>
 #include "ppelib-error.h"
+#include "ppelib-internal.h"
 #include "export.h"
 #include "utils.h"
 
@@ -78,7 +79,8 @@ size_t serialize_pe_header(const ppelib_header_t* header, uint8_t* buffer, size_
   }
 }
 
-size_t deserialize_pe_header(const uint8_t* buffer, size_t offset, const size_t size, ppelib_header_t* header) {
+size_t deserialize_pe_header(const uint8_t* buffer, size_t offset, const size_t size, ppelib_header_t* header,
+    ppelib_header_data_directory_t* directories_storage, size_t max_directories, ppelib_file_t* pe) {
   ppelib_reset_error();
 
   if (size - offset < {{sizes.common}}) {
@@ -134,10 +136,18 @@ size_t deserialize_pe_header(const uint8_t* buffer, size_t offset, const size_t
     return 0;
   }
 
-  header->data_directories = malloc(header->{{pe_rvas_field}} * PE_HEADER_DATA_DIRECTORIES_SIZE);
-  if (!header->data_directories) {
-	ppelib_set_error("Failed to allocate data directories.");
-	return 0;
+  if (directories_storage) {
+    if (header->{{pe_rvas_field}} > max_directories) {
+      ppelib_set_error("Too many directory entries for storage.");
+      return 0;
+    }
+    header->data_directories = directories_storage;
+  } else {
+    header->data_directories = arena_alloc(&pe->arena, header->{{pe_rvas_field}} * PE_HEADER_DATA_DIRECTORIES_SIZE);
+    if (!header->data_directories) {
+      ppelib_set_error("Failed to allocate data directories.");
+      return 0;
+    }
   }
 
   for (uint32_t i = 0; i < header->{{pe_rvas_field}}; ++i) {
@@ -25,12 +25,23 @@
 #include <ppelib/ppelib-section.h>
 
 #include "ppelib-error.h"
+#include "ppelib-internal.h"
 #include "export.h"
 #include "utils.h"
 
 
 {% from "print-field-macro.jinja" import print_field with context %}
 
+void serialize_section_header(const ppelib_section_t* section, uint8_t* section_header) {
+{%- for field in fields %}
+{%- if 'format' in field and 'string' in field.format %}
+  memcpy(section_header + {{field.offset}}, section->{{field.name}}, {{field.pe_size}});
+{%- else %}
+  write_{{field.pe_type}}(section_header + {{field.offset}}, section->{{field.name}});
+{%- endif %}
+{%- endfor %}
+}
+
 size_t serialize_section(const ppelib_section_t* section, uint8_t* buffer, size_t offset) {
   ppelib_reset_error();
 
@@ -40,15 +51,7 @@ size_t serialize_section(const ppelib_section_t* section, uint8_t* buffer, size_
     goto end;
   }
 
-  uint8_t* section_header = buffer + offset;
-
-{%- for field in fields %}
-{%- if 'format' in field and 'string' in field.format %}
-  memcpy(section_header + {{field.offset}}, section->{{field.name}}, {{field.pe_size}});
-{%- else %}
-  write_{{field.pe_type}}(section_header + {{field.offset}}, section->{{field.name}});
-{%- endif %}
-{%- endfor %}
+  serialize_section_header(section, buffer + offset);
 
   if (data_size) {
     memcpy(buffer + section->{{pointer_field}}, section->contents, data_size);
@@ -62,7 +65,8 @@ size_t serialize_section(const ppelib_section_t* section, uint8_t* buffer, size_
   }
 }
 
-size_t deserialize_section(const uint8_t* buffer, size_t offset, const size_t size, ppelib_section_t* section) {
+// Copied contents are allocated from arena, which may be NULL when mode isn't CONTENTS_COPY.
+size_t deserialize_section(const uint8_t* buffer, size_t offset, const size_t size, ppelib_section_t* section, ppelib_contents_mode_t mode, ppelib_arena_t* arena) {
   ppelib_reset_error();
 
   if (size - offset < PE_SECTION_HEADER_SIZE) {
@@ -83,16 +87,27 @@ size_t deserialize_section(const uint8_t* buffer, size_t offset, const size_t si
 
   size_t data_size = MIN(section->{{virtualsize_field}}, section->{{rawsize_field}});
 
+  if (mode == CONTENTS_NONE) {
+    goto end;
+  }
+
   if (section->{{pointer_field}} + data_size > size) {
 	ppelib_set_error("Buffer too small for section size.");
     return 0;
   }
 
-  if (data_size) {
-    section->contents = malloc(data_size);
+  if (data_size && mode == CONTENTS_BORROW) {
+    section->contents = (uint8_t*)buffer + section->{{pointer_field}};
+  } else if (data_size) {
+    section->contents = arena_alloc(arena, data_size);
+    if (!section->contents) {
+      ppelib_set_error("Failed to allocate section contents.");
+      return 0;
+    }
     memcpy(section->contents, buffer + section->{{pointer_field}}, data_size);
   }
 
+  end:
   if (section->{{pointer_field}} > offset) {
     return section->{{pointer_field}} + data_size;
   } else {
@@ -0,0 +1,31 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef PPELIB_ALLOCATOR_H_
+#define PPELIB_ALLOCATOR_H_
+
+#include <stddef.h>
+
+// Memory functions used by ppelib instead of malloc(), realloc() and free(). They follow the C library semantics and
+// may return NULL on failure. free is never called with NULL. context is passed to every call.
+typedef struct ppelib_allocator {
+	void* (*alloc)(void* context, size_t size);
+	void* (*realloc)(void* context, void* ptr, size_t size);
+	void (*free)(void* context, void* ptr);
+	void* context;
+} ppelib_allocator_t;
+
+#endif /* PPELIB_ALLOCATOR_H_ */
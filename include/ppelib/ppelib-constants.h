@@ -26,9 +26,34 @@
 
 #define COFF_HEADER_SIZE 20
 #define PE_HEADER_DATA_DIRECTORIES_SIZE 8
+// Offset of the checksum field from the start of the optional header, the same for PE32 and PE32+
+#define PE_CHECKSUM_OFFSET 64
 
 #define PE_SECTION_HEADER_SIZE 40
 
+#define PE_MAX_DATA_DIRECTORIES 16
+#define PE_MAX_SECTIONS 96
+#define PE_MAX_LONG_NAME 255
+#define PE_MAX_IMPORT_SYMBOLS (1 << 20)
+
+enum ppelib_digest_algorithm {
+	PPELIB_DIGEST_SHA1 = 1,
+	PPELIB_DIGEST_SHA256 = 2,
+	PPELIB_DIGEST_MD5 = 3,
+};
+
+#define PPELIB_MAX_DIGEST_SIZE 32
+
+// Flags for ppelib_recalculate_with_flags()
+#define PPELIB_RECALCULATE_CHECKSUM 0x1
+
+// Flags for ppelib_fingerprint()
+#define PPELIB_FINGERPRINT_IMPHASH 0x1
+#define PPELIB_FINGERPRINT_RICH_HEADER 0x2
+#define PPELIB_FINGERPRINT_SECTION_MD5 0x4
+#define PPELIB_FINGERPRINT_SECTION_SHA256 0x8
+#define PPELIB_FINGERPRINT_ALL 0xF
+
 #define PE_OPTIONAL_HEADER_STANDARD_ENTRIES 9
 #define PE_OPTIONAL_HEADER_STANDARD_SIZE 28
 #define PEPLUS_OPTIONAL_HEADER_STANDARD_ENTRIES 8
@@ -420,4 +445,34 @@ static const ppelib_map_entry_t ppelib_certificate_type_map[] = {
 	{"WIN_CERT_TYPE_TS_STACK_SIGNED", 4},
 	{NULL, 0}
 };
+
+enum ppelib_base_relocation_type {
+	IMAGE_REL_BASED_ABSOLUTE = 0,
+	IMAGE_REL_BASED_HIGH = 1,
+	IMAGE_REL_BASED_LOW = 2,
+	IMAGE_REL_BASED_HIGHLOW = 3,
+	IMAGE_REL_BASED_HIGHADJ = 4,
+	IMAGE_REL_BASED_MIPS_JMPADDR = 5,
+	IMAGE_REL_BASED_ARM_MOV32 = 5,
+	IMAGE_REL_BASED_RISCV_HIGH20 = 5,
+	IMAGE_REL_BASED_THUMB_MOV32 = 7,
+	IMAGE_REL_BASED_RISCV_LOW12I = 7,
+	IMAGE_REL_BASED_RISCV_LOW12S = 8,
+	IMAGE_REL_BASED_MIPS_JMPADDR16 = 9,
+	IMAGE_REL_BASED_DIR64 = 10,
+};
+
+static const ppelib_map_entry_t ppelib_base_relocation_type_map[] = {
+	{"IMAGE_REL_BASED_ABSOLUTE", 0},
+	{"IMAGE_REL_BASED_HIGH", 1},
+	{"IMAGE_REL_BASED_LOW", 2},
+	{"IMAGE_REL_BASED_HIGHLOW", 3},
+	{"IMAGE_REL_BASED_HIGHADJ", 4},
+	{"IMAGE_REL_BASED_MIPS_JMPADDR", 5},
+	{"IMAGE_REL_BASED_THUMB_MOV32", 7},
+	{"IMAGE_REL_BASED_RISCV_LOW12S", 8},
+	{"IMAGE_REL_BASED_MIPS_JMPADDR16", 9},
+	{"IMAGE_REL_BASED_DIR64", 10},
+	{NULL, 0}
+};
 #endif
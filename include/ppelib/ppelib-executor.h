@@ -0,0 +1,36 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PPELIB_EXECUTOR_H_
+#define PPELIB_EXECUTOR_H_
+
+#include <stddef.h>
+
+// Thread pool used to spread work over several cores. run calls task(argument, index) for every index below count
+// and returns once all of them have finished. The tasks are independent of each other and may run in any order, on
+// any thread including the calling one. context is passed to every call.
+//
+// concurrency is the number of tasks that can run at the same time, work is split accordingly. With run set to NULL
+// ppelib starts concurrency threads of its own for every call instead. A concurrency of 0 or 1 runs everything on the
+// calling thread.
+typedef struct ppelib_executor {
+	void (*run)(void* context, void (*task)(void* argument, size_t index), void* argument, size_t count);
+	void* context;
+	size_t concurrency;
+} ppelib_executor_t;
+
+#endif /* PPELIB_EXECUTOR_H_ */
@@ -0,0 +1,58 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PPELIB_EXPORT_TABLE_H_
+#define PPELIB_EXPORT_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct ppelib_export_name {
+	const char* name;
+	// Index into ppelib_export_table_t::addresses, the ordinal minus the ordinal base
+	uint32_t address_index;
+} ppelib_export_name_t;
+
+// Strings point into the section contents and stay valid until the section is modified or the handle destroyed
+typedef struct ppelib_export_table {
+	const char* name;
+
+	uint32_t characteristics;
+	uint32_t time_date_stamp;
+	uint16_t major_version;
+	uint16_t minor_version;
+	uint32_t ordinal_base;
+
+	size_t number_of_addresses;
+	uint32_t* addresses;
+
+	// Sorted by name
+	size_t number_of_names;
+	ppelib_export_name_t* names;
+} ppelib_export_table_t;
+
+typedef struct ppelib_export {
+	uint32_t ordinal;
+	uint32_t address;
+
+	// NULL for exports by ordinal only
+	const char* name;
+	// "DLL.Function" or "DLL.#ordinal" for forwarded exports, whose address is then the address of this string
+	const char* forwarder;
+} ppelib_export_t;
+
+#endif /* PPELIB_EXPORT_TABLE_H_ */
@@ -0,0 +1,44 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PPELIB_FINGERPRINT_H_
+#define PPELIB_FINGERPRINT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ppelib/ppelib-constants.h>
+
+// Section hashes cover the section as it would be written: its contents followed by zeroes up to size_of_raw_data
+typedef struct ppelib_section_fingerprint {
+	uint8_t md5[16];
+	uint8_t sha256[32];
+} ppelib_section_fingerprint_t;
+
+typedef struct ppelib_fingerprint {
+	// MD5 of the lowercased "dll.function" import list. Like pefile, ordinal imports from ws2_32, wsock32 and oleaut32
+	// are named after the function they resolve to and all other ordinal imports "ord<n>".
+	uint8_t imphash[16];
+	// MD5 of the decoded Rich header, from the DanS marker up to the Rich marker
+	uint8_t rich_header_hash[16];
+
+	// Indexed like the sections of the file, only the first PE_MAX_SECTIONS are fingerprinted
+	size_t number_of_sections;
+	ppelib_section_fingerprint_t sections[PE_MAX_SECTIONS];
+} ppelib_fingerprint_t;
+
+#endif /* PPELIB_FINGERPRINT_H_ */
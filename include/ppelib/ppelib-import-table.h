@@ -0,0 +1,59 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PPELIB_IMPORT_TABLE_H_
+#define PPELIB_IMPORT_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Names are offsets into ppelib_import_table_t::strings, which holds every name once, NUL terminated
+typedef struct ppelib_import_symbol {
+	uint8_t by_ordinal;
+	// The ordinal for imports by ordinal, the hint otherwise
+	uint16_t ordinal;
+	uint32_t name;
+
+	// RVA of the IAT slot the loader writes the address of this symbol to
+	uint32_t iat_rva;
+} ppelib_import_symbol_t;
+
+typedef struct ppelib_import_descriptor {
+	uint32_t name;
+
+	uint32_t original_first_thunk;
+	uint32_t time_date_stamp;
+	uint32_t forwarder_chain;
+	uint32_t first_thunk;
+
+	// The symbols imported from this DLL are symbols[first_symbol] up to symbols[first_symbol + number_of_symbols]
+	size_t first_symbol;
+	size_t number_of_symbols;
+} ppelib_import_descriptor_t;
+
+typedef struct ppelib_import_table {
+	size_t number_of_descriptors;
+	ppelib_import_descriptor_t* descriptors;
+
+	size_t number_of_symbols;
+	ppelib_import_symbol_t* symbols;
+
+	size_t strings_size;
+	char* strings;
+} ppelib_import_table_t;
+
+#endif /* PPELIB_IMPORT_TABLE_H_ */
@@ -21,12 +21,57 @@
 #include <ppelib/ppelib.h>
 
 void ppelib_recalculate(ppelib_handle* file);
+// flags is a combination of PPELIB_RECALCULATE_* flags
+void ppelib_recalculate_with_flags(ppelib_handle* file, uint32_t flags);
 
-ppelib_header_t* ppelib_get_header(ppelib_handle* handle);
+ppelib_header_t* ppelib_get_header(const ppelib_handle* handle);
 void ppelib_free_header(ppelib_header_t* header);
 void ppelib_set_header(ppelib_handle* handle, ppelib_header_t* header);
 
-ppelib_resource_table_t* ppelib_get_resource_table(ppelib_handle* handle);
+// Changes in section contents are only picked up by ppelib_write_patch_to_file() when made through this function
+void ppelib_section_write(ppelib_handle* handle, uint16_t section_index, size_t offset, const uint8_t* data,
+		size_t size);
+
+// Section names with object style long names ("/123") resolved through the COFF string table
+const char* ppelib_section_get_name(const ppelib_handle* handle, uint16_t section_index);
+ppelib_section_t* ppelib_section_find_by_name(const ppelib_handle* handle, const char* name);
+
+// Translate addresses using the section table. Addresses inside the headers map to themselves.
+ppelib_section_t* ppelib_rva_to_section(const ppelib_handle* handle, size_t rva);
+size_t ppelib_rva_to_offset(const ppelib_handle* handle, size_t rva);
+size_t ppelib_offset_to_rva(const ppelib_handle* handle, size_t offset);
+
+ppelib_certificate_table_t* ppelib_get_certificate_table(const ppelib_handle* handle);
+
+// Parsed on first use. Lookups by name are a binary search, lookups by ordinal an index into the address table.
+ppelib_export_table_t* ppelib_get_export_table(const ppelib_handle* handle);
+ppelib_export_t ppelib_export_find_by_name(const ppelib_handle* handle, const char* name);
+ppelib_export_t ppelib_export_find_by_ordinal(const ppelib_handle* handle, uint32_t ordinal);
+
+// Parsed on first use. Imports by name and DLL names are interned in one string blob.
+ppelib_import_table_t* ppelib_get_import_table(const ppelib_handle* handle);
+
+ppelib_relocation_table_t* ppelib_get_relocation_table(const ppelib_handle* handle);
+
+ppelib_resource_table_t* ppelib_get_resource_table(const ppelib_handle* handle);
+// The same, with the directories below each resource type parsed in batches spread over the executor. The tree is
+// identical to the one ppelib_get_resource_table() builds. The allocator of the handle is called from those threads.
+ppelib_resource_table_t* ppelib_get_resource_table_with_executor(const ppelib_handle* handle,
+		const ppelib_executor_t* executor);
 void ppelib_free_resource_directory_table(ppelib_resource_table_t* table);
 
+// With PPELIB_RESOURCE_ANY_LANGUAGE the entry with the lowest language ID is returned
+ppelib_resource_data_t* ppelib_resource_find(const ppelib_handle* handle, ppelib_resource_id_t type,
+		ppelib_resource_id_t name, uint32_t language);
+// Returns the first of count consecutive entries of the given type, or NULL if there are none
+const ppelib_resource_entry_t* ppelib_resource_find_type(const ppelib_handle* handle, ppelib_resource_id_t type,
+		size_t* count);
+
+// Byte histogram, entropy and chi-square, computed on first use and cached until the data changes through ppelib.
+// Sections are measured as written, zero padded up to their raw size. The overlay is the trailing data. The resource
+// entry must come from ppelib_resource_find_type() on the same handle.
+const ppelib_byte_stats_t* ppelib_section_stats(const ppelib_handle* handle, uint16_t section_index);
+const ppelib_byte_stats_t* ppelib_overlay_stats(const ppelib_handle* handle);
+const ppelib_byte_stats_t* ppelib_resource_stats(const ppelib_handle* handle, const ppelib_resource_entry_t* entry);
+
 #endif /* PPELIB_LOW_LEVEL_H_ */
@@ -0,0 +1,49 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PPELIB_PROBE_H_
+#define PPELIB_PROBE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-header.h>
+#include <ppelib/ppelib-section.h>
+
+// Number of bytes ppelib_probe_file() reads from the start of a file: the DOS stub and the PE headers, which have to
+// end within the first PPELIB_PROBE_HEADERS_SIZE bytes, followed by a section table of up to PE_MAX_SECTIONS sections.
+#define PPELIB_PROBE_HEADERS_SIZE 4096
+#define PPELIB_PROBE_SIZE (PPELIB_PROBE_HEADERS_SIZE + (PE_MAX_SECTIONS * PE_SECTION_HEADER_SIZE))
+
+// Result of a header-only probe. header.data_directories points into data_directories and the contents pointer of
+// every section is NULL. Files with more than PE_MAX_DATA_DIRECTORIES data directories or more than PE_MAX_SECTIONS
+// sections are rejected.
+typedef struct ppelib_probe {
+	size_t pe_header_offset;
+	size_t coff_header_offset;
+	size_t section_offset;
+
+	ppelib_header_t header;
+	ppelib_header_data_directory_t data_directories[PE_MAX_DATA_DIRECTORIES];
+	ppelib_section_t sections[PE_MAX_SECTIONS];
+} ppelib_probe_t;
+
+void ppelib_probe(const uint8_t* buffer, size_t size, ppelib_probe_t* probe);
+void ppelib_probe_file(const char* filename, ppelib_probe_t* probe);
+
+#endif /* PPELIB_PROBE_H_ */
@@ -0,0 +1,40 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PPELIB_READER_H_
+#define PPELIB_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of a single block in the reader block cache.
+#define PPELIB_READER_BLOCK_SIZE 4096
+
+// Random-access source for ppelib_create_from_reader(). read_at reads up to size bytes at offset into buffer and
+// returns the number of bytes read, 0 on error or end of file. context is passed to every call and must stay valid
+// until the handle is destroyed.
+//
+// size is the total size of the file. cache_blocks is the number of PPELIB_READER_BLOCK_SIZE blocks cached in front
+// of read_at for small reads, 0 disables the cache.
+typedef struct ppelib_reader {
+	size_t (*read_at)(void* context, size_t offset, uint8_t* buffer, size_t size);
+	void* context;
+	size_t size;
+	size_t cache_blocks;
+} ppelib_reader_t;
+
+#endif /* PPELIB_READER_H_ */
@@ -0,0 +1,47 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PPELIB_RELOCATION_TABLE_H_
+#define PPELIB_RELOCATION_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct ppelib_relocation {
+	// One of ppelib_base_relocation_type
+	uint8_t type;
+	uint32_t rva;
+} ppelib_relocation_t;
+
+typedef struct ppelib_relocation_block {
+	uint32_t page_rva;
+
+	// The entries of this block are relocations[first_relocation] up to relocations[first_relocation +
+	// number_of_relocations], including IMAGE_REL_BASED_ABSOLUTE padding
+	size_t first_relocation;
+	size_t number_of_relocations;
+} ppelib_relocation_block_t;
+
+typedef struct ppelib_relocation_table {
+	size_t number_of_blocks;
+	ppelib_relocation_block_t* blocks;
+
+	size_t number_of_relocations;
+	ppelib_relocation_t* relocations;
+} ppelib_relocation_table_t;
+
+#endif /* PPELIB_RELOCATION_TABLE_H_ */
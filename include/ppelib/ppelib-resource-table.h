@@ -52,6 +52,26 @@ typedef struct ppelib_resource_table {
 	struct ppelib_resource_data **data_entries;
 } ppelib_resource_table_t;
 
+// A resource type or name is either a string or a numeric ID
+typedef struct ppelib_resource_id {
+	const wchar_t* name;
+	uint32_t id;
+} ppelib_resource_id_t;
+
+#define PPELIB_RESOURCE_ID(x) ((ppelib_resource_id_t){ NULL, (x) })
+#define PPELIB_RESOURCE_NAME(x) ((ppelib_resource_id_t){ (x), 0 })
+#define PPELIB_RESOURCE_ANY_LANGUAGE 0xFFFFFFFF
+
+// One leaf of the type / name / language tree. Entries are sorted by type, then name, then language, the way PE
+// sorts directory entries: names before IDs.
+typedef struct ppelib_resource_entry {
+	ppelib_resource_id_t type;
+	ppelib_resource_id_t name;
+	uint32_t language;
+
+	ppelib_resource_data_t* data;
+} ppelib_resource_entry_t;
+
 void ppelib_print_resource_table(const ppelib_resource_table_t *resource_table);
 
 #endif /* PPELIB_RESOURCE_TABLE_H_ */
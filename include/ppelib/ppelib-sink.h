@@ -0,0 +1,32 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PPELIB_SINK_H_
+#define PPELIB_SINK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Destination for ppelib_write_to_sink(). write is called with consecutive ranges of the output image in file order
+// and must return the number of bytes written, anything other than size is treated as an error. data is NULL for
+// ranges that are all zeroes.
+typedef struct ppelib_sink {
+	size_t (*write)(void* context, size_t offset, const uint8_t* data, size_t size);
+	void* context;
+} ppelib_sink_t;
+
+#endif /* PPELIB_SINK_H_ */
@@ -0,0 +1,34 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PPELIB_STATS_H_
+#define PPELIB_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct ppelib_byte_stats {
+	uint64_t size;
+	uint64_t histogram[256];
+
+	// Shannon entropy in bits per byte, from 0 to 8
+	double entropy;
+	// Pearson's chi-square of the histogram against a uniform distribution, 0 for perfectly uniform data
+	double chi_square;
+} ppelib_byte_stats_t;
+
+#endif /* PPELIB_STATS_H_ */
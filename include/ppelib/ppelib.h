@@ -21,26 +21,122 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <ppelib/ppelib-allocator.h>
 #include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-executor.h>
 #include <ppelib/ppelib-certificate_table.h>
+#include <ppelib/ppelib-export-table.h>
+#include <ppelib/ppelib-fingerprint.h>
 #include <ppelib/ppelib-header.h>
+#include <ppelib/ppelib-import-table.h>
 #include <ppelib/ppelib-section.h>
+#include <ppelib/ppelib-probe.h>
+#include <ppelib/ppelib-reader.h>
+#include <ppelib/ppelib-relocation-table.h>
 #include <ppelib/ppelib-resource-table.h>
+#include <ppelib/ppelib-sink.h>
+#include <ppelib/ppelib-stats.h>
 
 typedef void ppelib_handle;
 
+// Thread safety: functions that take a const handle only read it and may be called from any number of threads on the
+// same handle at once. Whatever they parse or load on first use is done once, under a lock held by the handle, and the
+// reader of a handle is never called from two threads at once. Any other function needs exclusive access to the
+// handle. ppelib_error() reports the last error of the calling thread. Sharing a handle between threads also
+// requires its allocator to be thread safe.
+
 const char* ppelib_error();
 
+// Sets the allocator used by handles created afterwards, and for objects that are freed without a handle such as the
+// result of ppelib_get_header(). NULL restores the C library allocator. Set it before any other ppelib call; it must
+// not change while handles or objects allocated with it are alive.
+void ppelib_set_allocator(const ppelib_allocator_t* allocator);
+
 ppelib_handle* ppelib_create();
+// Creates an empty handle that does all of its allocations, including the handle itself, through allocator.
+ppelib_handle* ppelib_create_with_allocator(const ppelib_allocator_t* allocator);
 void ppelib_destroy(ppelib_handle* handle);
 
 ppelib_handle* ppelib_create_from_buffer(const uint8_t* buffer, size_t size);
+
+// Unloads the file but keeps the memory the handle has allocated, so loading the next file of a similar size
+// with ppelib_load_into() doesn't need to allocate.
+void ppelib_reset(ppelib_handle* handle);
+// Like ppelib_create_from_buffer() for an existing handle. Any previously loaded file is unloaded first; on error the
+// handle is left empty.
+void ppelib_load_into(ppelib_handle* handle, const uint8_t* buffer, size_t size);
+
+// Parses the buffer without copying it. Section contents, the stub, trailing data, certificates and resource data
+// point into the buffer, which must stay valid and unchanged until ppelib_destroy() is called on the handle.
+// ppelib never writes to the buffer; data is copied out of it before any modification.
+ppelib_handle* ppelib_create_from_buffer_borrowed(const uint8_t* buffer, size_t size);
 ppelib_handle* ppelib_create_from_file(const char* filename);
+// Maps the file instead of reading it; section contents point into the mapping until they are modified.
+// The file must not be truncated or modified while the handle is alive.
+ppelib_handle* ppelib_create_from_file_mapped(const char* filename);
+
+// Called by ppelib_create_from_files() once for every path, with the loaded handle, or with NULL and the error. The
+// handle belongs to the callback from then on. Calls never overlap but may come from different threads.
+typedef void (*ppelib_batch_callback_t)(void* context, size_t index, ppelib_handle* handle, const char* error);
+
+// Loads many files at once, keeping up to in_flight of them (0 for a default) being opened and read at the same time.
+// On Linux the files are opened, stat'ed and read through io_uring and parsed on the calling thread. Elsewhere, or
+// when io_uring isn't available, in_flight threads each open, read and parse files with pread(). Every handle keeps the
+// bytes it was read from, so the original file can still be checksummed and hashed.
+void ppelib_create_from_files(const char* const* paths, size_t count, size_t in_flight,
+		ppelib_batch_callback_t callback, void* context);
 
-size_t ppelib_write_to_buffer(ppelib_handle* handle, uint8_t* buffer, size_t size);
-size_t ppelib_write_to_file(ppelib_handle* handle, const char* filename);
+// Reads the headers through the reader right away. Section contents, trailing data and certificates are read when
+// they are first needed.
+ppelib_handle* ppelib_create_from_reader(const ppelib_reader_t* reader);
 
-uint32_t ppelib_has_signature(ppelib_handle* handle);
+size_t ppelib_write_to_buffer(const ppelib_handle* handle, uint8_t* buffer, size_t size);
+// Handles that still read from their source (borrowed, mapped and reader handles) write to a new file that is then
+// renamed over filename, so writing a handle back to the file it was loaded from is safe.
+size_t ppelib_write_to_file(const ppelib_handle* handle, const char* filename);
+// Streams the image to the sink without building it in memory first. Returns the size of the image.
+size_t ppelib_write_to_sink(const ppelib_handle* handle, const ppelib_sink_t* sink);
+// Updates the file the handle was loaded from in place, only writing the header bytes and section ranges that
+// changed since it was loaded (or last written). Falls back to writing the whole image when the layout changed, or
+// when filename isn't the file the handle was loaded from or last wrote to, which is always the case for handles
+// created from a buffer or a reader. Returns the number of bytes written.
+size_t ppelib_write_patch_to_file(ppelib_handle* handle, const char* filename);
+
+uint32_t ppelib_has_signature(const ppelib_handle* handle);
 void ppelib_signature_remove(ppelib_handle* handle);
 
+// The checksum of the image as it would be written, computed without building the image in memory
+uint32_t ppelib_compute_checksum(const ppelib_handle* handle);
+// Checks the checksum in the header against the file the handle was loaded from. This can differ from the checksum of
+// the image as it would be written when sections have slack data after their virtual size, which isn't written back.
+// Handles that copy the file sum it while loading.
+uint8_t ppelib_verify_checksum(const ppelib_handle* handle);
+// The same, with large sections and trailing data summed in chunks spread over the executor. Reader handles read the
+// next part of the file while the current one is being summed.
+uint32_t ppelib_compute_checksum_with_executor(const ppelib_handle* handle, const ppelib_executor_t* executor);
+uint8_t ppelib_verify_checksum_with_executor(const ppelib_handle* handle, const ppelib_executor_t* executor);
+
+// Authenticode digest of the image as it would be written, as needed to sign it. digest must hold
+// PPELIB_MAX_DIGEST_SIZE bytes. Returns the size of the digest.
+size_t ppelib_authenticode_digest(const ppelib_handle* handle, uint32_t algorithm, uint8_t* digest);
+// The same for the file the handle was loaded from, as needed to check an existing signature. Only works for
+// borrowed, mapped and reader handles.
+size_t ppelib_authenticode_digest_original(const ppelib_handle* handle, uint32_t algorithm, uint8_t* digest);
+// The digest can't be split up, but for reader handles the next part of the file is read on the executor while the
+// current one is hashed.
+size_t ppelib_authenticode_digest_original_with_executor(const ppelib_handle* handle, uint32_t algorithm,
+		uint8_t* digest, const ppelib_executor_t* executor);
+
+// Computes the PPELIB_FINGERPRINT_* fingerprints requested in flags in a single pass over the parsed file. Returns the
+// flags of the fingerprints that were computed, which leaves out those the file has nothing to compute them over.
+uint32_t ppelib_fingerprint(const ppelib_handle* handle, uint32_t flags, ppelib_fingerprint_t* fingerprint);
+// The same, with the sections hashed in parallel on the executor. Their contents are loaded first, on the calling
+// thread.
+uint32_t ppelib_fingerprint_with_executor(const ppelib_handle* handle, uint32_t flags,
+		ppelib_fingerprint_t* fingerprint, const ppelib_executor_t* executor);
+
+// Applies the HIGHLOW and DIR64 base relocations for the new image base to the section contents and updates the
+// image base in the header. Fails without changing anything when the file has other relocation types.
+void ppelib_rebase(ppelib_handle* handle, uint64_t image_base);
+
 #endif /* PPELIB_H_ */
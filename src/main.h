@@ -18,7 +18,22 @@
 #ifndef PPELIB_MAIN_H_
 #define PPELIB_MAIN_H_
 
+#include <stdatomic.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <ppelib/ppelib-allocator.h>
+#include <ppelib/ppelib-reader.h>
+#include <ppelib/ppelib-export-table.h>
+#include <ppelib/ppelib-import-table.h>
+#include <ppelib/ppelib-relocation-table.h>
 #include <ppelib/ppelib-resource-table.h>
+#include <ppelib/ppelib-stats.h>
 
 #include "ppelib-header.h"
 #include "ppelib-section.h"
@@ -34,7 +49,69 @@ typedef struct ppelib_data_directory {
 	uint32_t orig_size;
 } ppelib_data_directory_t;
 
+typedef struct ppelib_block_cache {
+	size_t number_of_blocks;
+	size_t *tags;
+	uint8_t *data;
+} ppelib_block_cache_t;
+
+typedef struct ppelib_arena_chunk {
+	struct ppelib_arena_chunk *next;
+	size_t size;
+	size_t used;
+} ppelib_arena_chunk_t;
+
+// Parse-time allocations (section structures and copies, resource nodes, names) live here and are released together
+typedef struct ppelib_arena {
+	const ppelib_allocator_t *allocator;
+	ppelib_arena_chunk_t *chunks;
+} ppelib_arena_t;
+
+typedef struct ppelib_range {
+	size_t offset;
+	size_t size;
+} ppelib_range_t;
+
+// Tells files apart without reading them. The inode is always 0 on Windows.
+typedef struct ppelib_file_identity {
+	uint8_t known;
+	uint64_t device;
+	uint64_t inode;
+	int64_t modified;
+} ppelib_file_identity_t;
+
+typedef struct ppelib_section_range {
+	size_t start;
+	size_t end;
+	uint16_t index;
+} ppelib_section_range_t;
+
+typedef struct ppelib_fixup_run {
+	uint16_t section_index;
+	uint8_t type;
+	size_t first_fixup;
+	size_t number_of_fixups;
+} ppelib_fixup_run_t;
+
+typedef struct ppelib_stats_cache {
+	size_t number_of_entries;
+	uint8_t *valid;
+	ppelib_byte_stats_t *stats;
+} ppelib_stats_cache_t;
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION ppelib_lock_t;
+#else
+typedef pthread_mutex_t ppelib_lock_t;
+#endif
+
 typedef struct ppelib_file {
+	ppelib_allocator_t allocator;
+	ppelib_arena_t arena;
+
+	// Held while anything is parsed or loaded on first use, so readers can share the handle. Recursive.
+	ppelib_lock_t lock;
+
 	size_t pe_header_offset;
 	size_t coff_header_offset;
 	size_t section_offset;
@@ -44,14 +121,77 @@ typedef struct ppelib_file {
 
 	ppelib_header_t header;
 	ppelib_section_t **sections;
+
+	size_t allocated_section_index;
+	size_t indexed_sections_by_rva;
+	ppelib_section_range_t *sections_by_rva;
+	size_t indexed_sections_by_offset;
+	ppelib_section_range_t *sections_by_offset;
+
+	const char **section_names;
+	size_t section_name_buckets;
+	uint16_t *section_name_index;
 	ppelib_data_directory_t *data_directories;
 
+	atomic_uchar certificate_table_parsed;
+	const char *certificate_table_error;
 	ppelib_certificate_table_t certificate_table;
+	atomic_uchar relocation_table_parsed;
+	const char *relocation_table_error;
+	ppelib_relocation_table_t relocation_table;
+	// Offsets into the section contents, decoded on the first rebase
+	uint8_t fixups_decoded;
+	size_t number_of_fixup_runs;
+	ppelib_fixup_run_t *fixup_runs;
+	uint32_t *fixup_offsets;
+	atomic_uchar resource_table_parsed;
+	const char *resource_table_error;
 	ppelib_resource_table_t resource_table;
+	atomic_uchar resource_index_built;
+	atomic_uchar export_table_parsed;
+	const char *export_table_error;
+	ppelib_export_table_t export_table;
+	const char **export_names_by_address;
+	size_t export_table_start;
+	size_t export_table_end;
+	atomic_uchar import_table_parsed;
+	const char *import_table_error;
+	ppelib_import_table_t import_table;
+	size_t number_of_resources;
+	ppelib_resource_entry_t *resources;
+
+	ppelib_stats_cache_t section_stats;
+	ppelib_stats_cache_t overlay_stats;
+	ppelib_stats_cache_t resource_stats;
 
 	uint8_t *stub;
 	size_t trailing_data_size;
 	uint8_t *trailing_data;
+
+	const uint8_t *file_buffer;
+	size_t file_buffer_size;
+	uint8_t file_buffer_mapped;
+	// Read into memory allocated through the handle by ppelib_create_from_files(), freed with the handle
+	uint8_t file_buffer_owned;
+
+	ppelib_reader_t reader;
+	ppelib_block_cache_t block_cache;
+
+	// State of the file as loaded, used by ppelib_write_patch_to_file()
+	uint8_t *original_headers;
+	size_t original_headers_size;
+	size_t allocated_original_headers;
+	size_t original_pe_header_offset;
+	size_t original_size;
+	// Checksum of the file as loaded by handles that don't keep it, 0 in file_checksum_known otherwise
+	uint8_t file_checksum_known;
+	uint32_t file_checksum;
+	// The file on disk the snapshot was taken from, the only one a patch is written into
+	ppelib_file_identity_t source;
+
+	size_t number_of_dirty_ranges;
+	size_t allocated_dirty_ranges;
+	ppelib_range_t *dirty_ranges;
 } ppelib_file_t;
 
 #endif /* PPELIB_MAIN_H_ */
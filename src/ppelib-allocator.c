@@ -0,0 +1,95 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ppelib/ppelib-allocator.h>
+
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "main.h"
+
+void* libc_alloc(void *context, size_t size) {
+	(void)context;
+	return malloc(size);
+}
+
+void* libc_realloc(void *context, void *ptr, size_t size) {
+	(void)context;
+	return realloc(ptr, size);
+}
+
+void libc_free(void *context, void *ptr) {
+	(void)context;
+	free(ptr);
+}
+
+ppelib_allocator_t global_allocator = { libc_alloc, libc_realloc, libc_free, NULL };
+
+// Handles use the allocator they were created with, everything else the global one
+const ppelib_allocator_t* get_allocator(const ppelib_file_t *pe) {
+	return pe ? &pe->allocator : &global_allocator;
+}
+
+void* mem_alloc(const ppelib_file_t *pe, size_t size) {
+	const ppelib_allocator_t *allocator = get_allocator(pe);
+
+	return allocator->alloc(allocator->context, size);
+}
+
+void* mem_calloc(const ppelib_file_t *pe, size_t size) {
+	void *retval = mem_alloc(pe, size);
+	if (retval) {
+		memset(retval, 0, size);
+	}
+
+	return retval;
+}
+
+void* mem_realloc(const ppelib_file_t *pe, void *ptr, size_t size) {
+	const ppelib_allocator_t *allocator = get_allocator(pe);
+
+	return allocator->realloc(allocator->context, ptr, size);
+}
+
+void mem_free(const ppelib_file_t *pe, void *ptr) {
+	if (!ptr) {
+		return;
+	}
+
+	const ppelib_allocator_t *allocator = get_allocator(pe);
+	allocator->free(allocator->context, ptr);
+}
+
+EXPORT_SYM void ppelib_set_allocator(const ppelib_allocator_t *allocator) {
+	ppelib_reset_error();
+
+	if (!allocator) {
+		global_allocator = (ppelib_allocator_t ) { libc_alloc, libc_realloc, libc_free, NULL };
+		return;
+	}
+
+	if (!allocator->alloc || !allocator->realloc || !allocator->free) {
+		ppelib_set_error("Incomplete allocator");
+		return;
+	}
+
+	global_allocator = *allocator;
+}
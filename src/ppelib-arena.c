@@ -0,0 +1,202 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "main.h"
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_MIN_CHUNK_SIZE 4096
+#define ARENA_MAX_GROWTH (256 * 1024)
+#define ARENA_CHUNK_HEADER_SIZE (TO_NEAREST(sizeof(ppelib_arena_chunk_t), ARENA_ALIGNMENT))
+
+uint8_t* arena_chunk_data(ppelib_arena_chunk_t *chunk) {
+	return (uint8_t*)chunk + ARENA_CHUNK_HEADER_SIZE;
+}
+
+// Chunks double in size, but only up to ARENA_MAX_GROWTH so one large allocation doesn't inflate all later chunks
+size_t arena_chunk_size(const ppelib_arena_t *arena) {
+	if (!arena->chunks) {
+		return ARENA_MIN_CHUNK_SIZE;
+	}
+
+	return MAX(MIN(arena->chunks->size * 2, ARENA_MAX_GROWTH), ARENA_MIN_CHUNK_SIZE);
+}
+
+ppelib_arena_chunk_t* arena_new_chunk(ppelib_arena_t *arena, size_t size) {
+	const ppelib_allocator_t *allocator = arena->allocator;
+
+	ppelib_arena_chunk_t *chunk = allocator->alloc(allocator->context, ARENA_CHUNK_HEADER_SIZE + size);
+	if (!chunk) {
+		ppelib_set_error("Failed to allocate arena chunk");
+		return NULL;
+	}
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+uint8_t arena_add_chunk(ppelib_arena_t *arena, size_t size) {
+	ppelib_arena_chunk_t *chunk = arena_new_chunk(arena, MAX(size, arena_chunk_size(arena)));
+	if (!chunk) {
+		return 0;
+	}
+
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+
+	return 1;
+}
+
+// Allocations larger than the next chunk get an exact chunk of their own. It goes behind the current chunk, which
+// keeps serving the small allocations.
+void* arena_alloc_dedicated(ppelib_arena_t *arena, size_t size) {
+	ppelib_arena_chunk_t *chunk = arena_new_chunk(arena, size);
+	if (!chunk) {
+		return NULL;
+	}
+
+	chunk->used = size;
+
+	if (arena->chunks) {
+		chunk->next = arena->chunks->next;
+		arena->chunks->next = chunk;
+	} else {
+		arena->chunks = chunk;
+	}
+
+	return arena_chunk_data(chunk);
+}
+
+// Makes sure the next size bytes of allocations come from a single chunk
+void arena_reserve(ppelib_arena_t *arena, size_t size) {
+	if (arena->chunks && arena->chunks->size - arena->chunks->used >= size) {
+		return;
+	}
+
+	arena_add_chunk(arena, size);
+}
+
+void* arena_alloc(ppelib_arena_t *arena, size_t size) {
+	// Zero sized allocations still get their own byte so every returned pointer is inside a chunk
+	size = TO_NEAREST(MAX(size, 1), ARENA_ALIGNMENT);
+
+	ppelib_arena_chunk_t *chunk = arena->chunks;
+	if (!chunk || chunk->size - chunk->used < size) {
+		if (size > arena_chunk_size(arena)) {
+			return arena_alloc_dedicated(arena, size);
+		}
+
+		if (!arena_add_chunk(arena, size)) {
+			return NULL;
+		}
+		chunk = arena->chunks;
+	}
+
+	void *retval = arena_chunk_data(chunk) + chunk->used;
+	chunk->used += size;
+
+	return retval;
+}
+
+void* arena_calloc(ppelib_arena_t *arena, size_t size) {
+	void *retval = arena_alloc(arena, size);
+	if (retval) {
+		memset(retval, 0, size);
+	}
+
+	return retval;
+}
+
+uint8_t arena_owns(const ppelib_arena_t *arena, const void *ptr) {
+	for (ppelib_arena_chunk_t *chunk = arena->chunks; chunk; chunk = chunk->next) {
+		const uint8_t *data = arena_chunk_data(chunk);
+
+		if ((const uint8_t*)ptr >= data && (const uint8_t*)ptr < data + chunk->size) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Moves the chunks of other into arena, behind the current one so allocations keep coming from that
+void arena_merge(ppelib_arena_t *arena, ppelib_arena_t *other) {
+	ppelib_arena_chunk_t *last = other->chunks;
+	if (!last) {
+		return;
+	}
+
+	while (last->next) {
+		last = last->next;
+	}
+
+	if (arena->chunks) {
+		last->next = arena->chunks->next;
+		arena->chunks->next = other->chunks;
+	} else {
+		arena->chunks = other->chunks;
+	}
+
+	other->chunks = NULL;
+}
+
+// Keeps only the largest chunk, which is what the next file most likely needs
+void arena_reset(ppelib_arena_t *arena) {
+	ppelib_arena_chunk_t *largest = NULL;
+
+	ppelib_arena_chunk_t *chunk = arena->chunks;
+	while (chunk) {
+		ppelib_arena_chunk_t *next = chunk->next;
+
+		if (!largest || chunk->size > largest->size) {
+			if (largest) {
+				arena->allocator->free(arena->allocator->context, largest);
+			}
+			largest = chunk;
+		} else {
+			arena->allocator->free(arena->allocator->context, chunk);
+		}
+
+		chunk = next;
+	}
+
+	if (largest) {
+		largest->next = NULL;
+		largest->used = 0;
+	}
+
+	arena->chunks = largest;
+}
+
+void arena_destroy(ppelib_arena_t *arena) {
+	ppelib_arena_chunk_t *chunk = arena->chunks;
+	while (chunk) {
+		ppelib_arena_chunk_t *next = chunk->next;
+		arena->allocator->free(arena->allocator->context, chunk);
+		chunk = next;
+	}
+
+	arena->chunks = NULL;
+}
@@ -0,0 +1,184 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ppelib/ppelib-constants.h>
+
+#include "main.h"
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "utils.h"
+
+// The checksum, the certificate table directory entry and the certificate table itself
+#define DIGEST_EXCLUDED_RANGES 3
+
+typedef struct digest_sink {
+	hash_context_t hash;
+
+	size_t number_of_excluded;
+	ppelib_range_t excluded[DIGEST_EXCLUDED_RANGES];
+} digest_sink_t;
+
+void digest_feed(digest_sink_t *digest, const uint8_t *data, size_t size) {
+	static const uint8_t zeroes[HASH_BLOCK_SIZE * 16];
+
+	if (data) {
+		hash_update(&digest->hash, data, size);
+		return;
+	}
+
+	while (size) {
+		size_t chunk = MIN(size, sizeof(zeroes));
+		hash_update(&digest->hash, zeroes, chunk);
+		size -= chunk;
+	}
+}
+
+// Hashes everything outside of the excluded ranges, which are sorted by offset
+size_t digest_sink_write(void *context, size_t offset, const uint8_t *data, size_t size) {
+	digest_sink_t *digest = context;
+	size_t position = offset;
+	size_t end = offset + size;
+
+	for (size_t i = 0; i < digest->number_of_excluded && position < end; ++i) {
+		const ppelib_range_t *range = &digest->excluded[i];
+
+		if (range->offset + range->size <= position) {
+			continue;
+		}
+
+		if (range->offset >= end) {
+			break;
+		}
+
+		if (range->offset > position) {
+			digest_feed(digest, data ? data + (position - offset) : NULL, range->offset - position);
+		}
+
+		position = MIN(range->offset + range->size, end);
+	}
+
+	if (position < end) {
+		digest_feed(digest, data ? data + (position - offset) : NULL, end - position);
+	}
+
+	return size;
+}
+
+int compare_digest_ranges(const void *a, const void *b) {
+	const ppelib_range_t *ra = a;
+	const ppelib_range_t *rb = b;
+
+	if (ra->offset == rb->offset) {
+		return 0;
+	}
+
+	return ra->offset < rb->offset ? -1 : 1;
+}
+
+void digest_exclude(digest_sink_t *digest, size_t offset, size_t size) {
+	digest->excluded[digest->number_of_excluded].offset = offset;
+	digest->excluded[digest->number_of_excluded].size = size;
+	digest->number_of_excluded++;
+}
+
+uint8_t digest_init(digest_sink_t *digest, const ppelib_file_t *pe, uint32_t algorithm, size_t pe_header_offset) {
+	if (!hash_digest_size(algorithm)) {
+		ppelib_set_error("Unknown digest algorithm");
+		return 0;
+	}
+
+	memset(digest, 0, sizeof(digest_sink_t));
+	hash_init(&digest->hash, algorithm);
+
+	digest_exclude(digest, checksum_field_offset(pe_header_offset), sizeof(uint32_t));
+
+	if (pe->header.number_of_rva_and_sizes > DIR_CERTIFICATE_TABLE) {
+		size_t optional_header_size = PE_OPTIONAL_HEADER_STANDARD_SIZE + PE_OPTIONAL_HEADER_WINDOWS_SIZE;
+		if (pe->header.magic == PE32PLUS_MAGIC) {
+			optional_header_size = PEPLUS_OPTIONAL_HEADER_STANDARD_SIZE + PEPLUS_OPTIONAL_HEADER_WINDOWS_SIZE;
+		}
+
+		size_t directory_offset = pe_header_offset + 4 + COFF_HEADER_SIZE + optional_header_size
+				+ (DIR_CERTIFICATE_TABLE * PE_HEADER_DATA_DIRECTORIES_SIZE);
+		digest_exclude(digest, directory_offset, PE_HEADER_DATA_DIRECTORIES_SIZE);
+
+		const ppelib_header_data_directory_t *directory = &pe->header.data_directories[DIR_CERTIFICATE_TABLE];
+		if (directory->size) {
+			digest_exclude(digest, directory->virtual_address, directory->size);
+		}
+	}
+
+	qsort(digest->excluded, digest->number_of_excluded, sizeof(ppelib_range_t), compare_digest_ranges);
+	return 1;
+}
+
+EXPORT_SYM size_t ppelib_authenticode_digest(ppelib_file_t *pe, uint32_t algorithm, uint8_t *digest) {
+	ppelib_reset_error();
+
+	digest_sink_t digest_sink;
+	if (!digest_init(&digest_sink, pe, algorithm, pe->pe_header_offset)) {
+		return 0;
+	}
+
+	ppelib_sink_t sink = { digest_sink_write, &digest_sink };
+	write_image(pe, &sink);
+	if (ppelib_error_peek()) {
+		return 0;
+	}
+
+	hash_final(&digest_sink.hash, digest);
+	return hash_digest_size(algorithm);
+}
+
+size_t authenticode_digest_original(ppelib_file_t *pe, uint32_t algorithm, uint8_t *digest,
+		const ppelib_executor_t *executor) {
+	size_t pe_header_offset = pe->original_headers_size ? pe->original_pe_header_offset : pe->pe_header_offset;
+
+	digest_sink_t digest_sink;
+	if (!digest_init(&digest_sink, pe, algorithm, pe_header_offset)) {
+		return 0;
+	}
+
+	ppelib_sink_t sink = { digest_sink_write, &digest_sink };
+	if (!stream_original_file(pe, &sink, executor)) {
+		if (!ppelib_error_peek()) {
+			ppelib_set_error("Handle has no file to read from");
+		}
+		return 0;
+	}
+
+	hash_final(&digest_sink.hash, digest);
+	return hash_digest_size(algorithm);
+}
+
+EXPORT_SYM size_t ppelib_authenticode_digest_original(ppelib_file_t *pe, uint32_t algorithm, uint8_t *digest) {
+	ppelib_reset_error();
+
+	return authenticode_digest_original(pe, algorithm, digest, NULL);
+}
+
+EXPORT_SYM size_t ppelib_authenticode_digest_original_with_executor(ppelib_file_t *pe, uint32_t algorithm,
+		uint8_t *digest, const ppelib_executor_t *executor) {
+	ppelib_reset_error();
+
+	return authenticode_digest_original(pe, algorithm, digest, executor);
+}
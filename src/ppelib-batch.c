@@ -0,0 +1,660 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef PPELIB_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+
+#include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-executor.h>
+
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "main.h"
+#include "utils.h"
+
+#define BATCH_DEFAULT_IN_FLIGHT 64
+
+typedef void (*batch_callback_t)(void *context, size_t index, ppelib_file_t *pe, const char *error);
+
+typedef struct batch {
+	const char *const *paths;
+	size_t count;
+	batch_callback_t callback;
+	void *context;
+
+	// Callbacks never overlap
+	ppelib_lock_t lock;
+} batch_t;
+
+// The file is only borrowed from the buffer, which now belongs to the handle and is freed along with it
+void load_owned_buffer(ppelib_file_t *pe, uint8_t *buffer, size_t size) {
+	load_from_buffer(pe, buffer, size, 1);
+	pe->file_buffer_owned = 1;
+}
+
+// Hands the handle to the callback, or the error of the calling thread when there is one
+void finish_batch_file(batch_t *batch, size_t index, ppelib_file_t *pe) {
+	if (ppelib_error_peek()) {
+		ppelib_destroy(pe);
+		pe = NULL;
+	}
+
+	acquire_lock(&batch->lock);
+	batch->callback(batch->context, index, pe, pe ? NULL : ppelib_error());
+	release_lock(&batch->lock);
+
+	ppelib_reset_error();
+}
+
+#ifndef _WIN32
+void read_batch_file(ppelib_file_t *pe, const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		ppelib_set_error("Failed to open file");
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st)) {
+		close(fd);
+		ppelib_set_error("Failed to stat file");
+		return;
+	}
+
+	ppelib_file_identity_t source;
+	identify_file(path, &source);
+
+	if (!st.st_size) {
+		close(fd);
+		ppelib_set_error("Empty file");
+		return;
+	}
+
+	size_t size = st.st_size;
+	uint8_t *buffer = mem_alloc(pe, size);
+	if (!buffer) {
+		close(fd);
+		ppelib_set_error("Failed to allocate file data");
+		return;
+	}
+
+	for (size_t offset = 0; offset < size;) {
+		ssize_t retsize = pread(fd, buffer + offset, size - offset, offset);
+		if (retsize <= 0) {
+			if (retsize < 0 && errno == EINTR) {
+				continue;
+			}
+
+			close(fd);
+			mem_free(pe, buffer);
+			ppelib_set_error("Failed to read file data");
+			return;
+		}
+
+		offset += retsize;
+	}
+
+	close(fd);
+	load_owned_buffer(pe, buffer, size);
+	pe->source = source;
+}
+#else
+void read_batch_file(ppelib_file_t *pe, const char *path) {
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		ppelib_set_error("Failed to open file");
+		return;
+	}
+
+	ppelib_file_identity_t source;
+	identify_file(path, &source);
+
+	fseek(f, 0, SEEK_END);
+	size_t size = ftell(f);
+	rewind(f);
+
+	if (!size) {
+		fclose(f);
+		ppelib_set_error("Empty file");
+		return;
+	}
+
+	uint8_t *buffer = mem_alloc(pe, size);
+	if (!buffer) {
+		fclose(f);
+		ppelib_set_error("Failed to allocate file data");
+		return;
+	}
+
+	if (fread(buffer, 1, size, f) != size) {
+		fclose(f);
+		mem_free(pe, buffer);
+		ppelib_set_error("Failed to read file data");
+		return;
+	}
+
+	fclose(f);
+	load_owned_buffer(pe, buffer, size);
+	pe->source = source;
+}
+#endif
+
+// Runs on the worker threads of the fallback, every file is opened, read and parsed by a single thread
+void batch_file_task(void *argument, size_t index) {
+	batch_t *batch = argument;
+
+	ppelib_file_t *pe = ppelib_create();
+	if (pe) {
+		read_batch_file(pe, batch->paths[index]);
+	}
+
+	finish_batch_file(batch, index, pe);
+}
+
+#ifdef PPELIB_HAVE_IO_URING
+#define URING_OPEN 0
+#define URING_STATX 1
+#define URING_READ 2
+#define URING_CLOSE 3
+
+// The length of a single read is 32 bits
+#define URING_MAX_READ (1024 * 1024 * 1024)
+
+typedef struct uring {
+	int fd;
+	uint32_t entries;
+	uint32_t to_submit;
+
+	uint8_t *sq_ring;
+	size_t sq_ring_size;
+	uint8_t *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t *sq_mask;
+	uint32_t *sq_array;
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t *cq_mask;
+	struct io_uring_cqe *cqes;
+} uring_t;
+
+typedef struct uring_file {
+	ppelib_file_t *pe;
+	size_t index;
+
+	int fd;
+	uint8_t pending;
+	const char *error;
+
+	struct statx statx;
+	uint8_t *buffer;
+	size_t size;
+	size_t read;
+} uring_file_t;
+
+void uring_destroy(uring_t *ring) {
+	if (ring->sqes) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+	if (ring->sq_ring) {
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	}
+
+	close(ring->fd);
+}
+
+// Opening and stat'ing by path came with the probe, kernels without it use the fallback
+uint8_t uring_supported(const uring_t *ring) {
+	static const uint8_t needed[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE };
+	size_t probe_size = sizeof(struct io_uring_probe) + (256 * sizeof(struct io_uring_probe_op));
+
+	struct io_uring_probe *probe = mem_calloc(NULL, probe_size);
+	if (!probe) {
+		return 0;
+	}
+
+	uint8_t retval = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+	for (size_t i = 0; retval && i < sizeof(needed); ++i) {
+		retval = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+	}
+
+	mem_free(NULL, probe);
+	return retval;
+}
+
+uint8_t uring_init(uring_t *ring, uint32_t entries) {
+	memset(ring, 0, sizeof(uring_t));
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) {
+		return 0;
+	}
+
+	ring->entries = params.sq_entries;
+	ring->sq_ring_size = params.sq_off.array + (params.sq_entries * sizeof(uint32_t));
+	ring->cq_ring_size = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	uint8_t single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap) {
+		ring->sq_ring_size = MAX(ring->sq_ring_size, ring->cq_ring_size);
+	}
+
+	void *sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+			IORING_OFF_SQ_RING);
+	if (sq_ring == MAP_FAILED) {
+		uring_destroy(ring);
+		return 0;
+	}
+	ring->sq_ring = sq_ring;
+
+	if (single_mmap) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		void *cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+				IORING_OFF_CQ_RING);
+		if (cq_ring == MAP_FAILED) {
+			uring_destroy(ring);
+			return 0;
+		}
+		ring->cq_ring = cq_ring;
+	}
+
+	void *sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+			IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		uring_destroy(ring);
+		return 0;
+	}
+	ring->sqes = sqes;
+
+	ring->sq_head = (uint32_t*)(ring->sq_ring + params.sq_off.head);
+	ring->sq_tail = (uint32_t*)(ring->sq_ring + params.sq_off.tail);
+	ring->sq_mask = (uint32_t*)(ring->sq_ring + params.sq_off.ring_mask);
+	ring->sq_array = (uint32_t*)(ring->sq_ring + params.sq_off.array);
+	ring->cq_head = (uint32_t*)(ring->cq_ring + params.cq_off.head);
+	ring->cq_tail = (uint32_t*)(ring->cq_ring + params.cq_off.tail);
+	ring->cq_mask = (uint32_t*)(ring->cq_ring + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(ring->cq_ring + params.cq_off.cqes);
+
+	if (!uring_supported(ring)) {
+		uring_destroy(ring);
+		return 0;
+	}
+
+	return 1;
+}
+
+// The ring is sized for every operation that can be in flight, so there is always room
+struct io_uring_sqe* uring_queue(uring_t *ring, uint8_t opcode, uint64_t user_data) {
+	uint32_t tail = *ring->sq_tail;
+	uint32_t index = tail & *ring->sq_mask;
+
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = opcode;
+	sqe->user_data = user_data;
+
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->to_submit++;
+
+	return sqe;
+}
+
+// Submits everything queued and waits for at least one completion
+uint8_t uring_submit_and_wait(uring_t *ring) {
+	while (1) {
+		int retval = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (retval >= 0) {
+			ring->to_submit -= retval;
+			return 1;
+		}
+
+		if (errno != EINTR && errno != EAGAIN) {
+			return 0;
+		}
+	}
+}
+
+uint64_t uring_user_data(size_t slot, uint8_t operation) {
+	return (slot * 4) + operation;
+}
+
+void uring_queue_read(uring_t *ring, uring_file_t *file, size_t slot) {
+	struct io_uring_sqe *sqe = uring_queue(ring, IORING_OP_READ, uring_user_data(slot, URING_READ));
+	sqe->fd = file->fd;
+	sqe->addr = (uintptr_t)(file->buffer + file->read);
+	sqe->len = MIN(file->size - file->read, URING_MAX_READ);
+	sqe->off = file->read;
+
+	file->pending++;
+}
+
+void uring_queue_close(uring_t *ring, uring_file_t *file, size_t slot) {
+	struct io_uring_sqe *sqe = uring_queue(ring, IORING_OP_CLOSE, uring_user_data(slot, URING_CLOSE));
+	sqe->fd = file->fd;
+
+	file->fd = -1;
+}
+
+typedef struct uring_batch {
+	batch_t *batch;
+	uring_t ring;
+
+	size_t number_of_slots;
+	uring_file_t *files;
+	size_t *free_slots;
+	size_t number_of_free_slots;
+
+	// Operations submitted and not completed yet, including closes of files that are already finished
+	size_t in_flight;
+} uring_batch_t;
+
+void uring_start_file(uring_batch_t *state, size_t index) {
+	const char *path = state->batch->paths[index];
+
+	ppelib_file_t *pe = ppelib_create();
+	if (!pe) {
+		finish_batch_file(state->batch, index, NULL);
+		return;
+	}
+
+	size_t slot = state->free_slots[--state->number_of_free_slots];
+	uring_file_t *file = &state->files[slot];
+	memset(file, 0, sizeof(uring_file_t));
+	file->pe = pe;
+	file->index = index;
+	file->fd = -1;
+
+	struct io_uring_sqe *sqe = uring_queue(&state->ring, IORING_OP_OPENAT, uring_user_data(slot, URING_OPEN));
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uintptr_t)path;
+	sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+	sqe = uring_queue(&state->ring, IORING_OP_STATX, uring_user_data(slot, URING_STATX));
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uintptr_t)path;
+	sqe->len = STATX_SIZE | STATX_INO | STATX_MTIME;
+	sqe->off = (uintptr_t)&file->statx;
+
+	file->pending = 2;
+	state->in_flight += 2;
+}
+
+void uring_finish_file(uring_batch_t *state, size_t slot) {
+	uring_file_t *file = &state->files[slot];
+
+	if (file->fd >= 0) {
+		uring_queue_close(&state->ring, file, slot);
+		state->in_flight++;
+	}
+
+	if (file->error) {
+		mem_free(file->pe, file->buffer);
+		ppelib_set_error(file->error);
+	} else {
+		load_owned_buffer(file->pe, file->buffer, file->size);
+
+		const struct statx *statx = &file->statx;
+		if ((statx->stx_mask & (STATX_INO | STATX_MTIME)) == (STATX_INO | STATX_MTIME)) {
+			file->pe->source.known = 1;
+			file->pe->source.device = makedev(statx->stx_dev_major, statx->stx_dev_minor);
+			file->pe->source.inode = statx->stx_ino;
+			file->pe->source.modified = statx->stx_mtime.tv_sec;
+		}
+	}
+
+	finish_batch_file(state->batch, file->index, file->pe);
+
+	file->pe = NULL;
+	state->free_slots[state->number_of_free_slots++] = slot;
+}
+
+// Once the open and the statx are both done the whole file is read at once
+void uring_read_file(uring_batch_t *state, size_t slot) {
+	uring_file_t *file = &state->files[slot];
+
+	if (!file->error && !file->statx.stx_size) {
+		file->error = "Empty file";
+	}
+
+	if (!file->error && file->statx.stx_size > SIZE_MAX) {
+		file->error = "File too large";
+	}
+
+	if (!file->error) {
+		file->size = file->statx.stx_size;
+		file->buffer = mem_alloc(file->pe, file->size);
+		if (!file->buffer) {
+			file->error = "Failed to allocate file data";
+		}
+	}
+
+	if (file->error) {
+		uring_finish_file(state, slot);
+		return;
+	}
+
+	uring_queue_read(&state->ring, file, slot);
+	state->in_flight++;
+}
+
+void uring_complete(uring_batch_t *state, uint64_t user_data, int32_t result) {
+	size_t slot = user_data / 4;
+	uint8_t operation = user_data % 4;
+	uring_file_t *file = &state->files[slot];
+
+	state->in_flight--;
+	if (operation == URING_CLOSE) {
+		return;
+	}
+
+	file->pending--;
+
+	if (operation == URING_OPEN) {
+		if (result < 0) {
+			file->error = "Failed to open file";
+		} else {
+			file->fd = result;
+		}
+	} else if (operation == URING_STATX) {
+		if (result < 0 && !file->error) {
+			file->error = "Failed to stat file";
+		}
+	} else {
+		if (result <= 0) {
+			file->error = "Failed to read file data";
+		} else {
+			file->read += result;
+		}
+	}
+
+	if (file->pending) {
+		return;
+	}
+
+	if (operation != URING_READ) {
+		uring_read_file(state, slot);
+	} else if (!file->error && file->read < file->size) {
+		uring_queue_read(&state->ring, file, slot);
+		state->in_flight++;
+	} else {
+		uring_finish_file(state, slot);
+	}
+}
+
+// Only when io_uring_enter() itself fails. The kernel may not be done with the file buffers and the statx results yet,
+// so those are deliberately leaked.
+void fail_uring_batch(uring_batch_t *state, size_t next) {
+	batch_t *batch = state->batch;
+
+	for (size_t slot = 0; slot < state->number_of_slots; ++slot) {
+		uring_file_t *file = &state->files[slot];
+		if (!file->pe) {
+			continue;
+		}
+
+		if (file->fd >= 0) {
+			close(file->fd);
+		}
+
+		ppelib_set_error("Failed to read file data");
+		finish_batch_file(batch, file->index, file->pe);
+	}
+
+	for (; next < batch->count; ++next) {
+		ppelib_set_error("Failed to read file data");
+		finish_batch_file(batch, next, NULL);
+	}
+
+	mem_free(NULL, state->free_slots);
+}
+
+// Returns 0 without loading anything when io_uring can't be used
+uint8_t load_batch_uring(batch_t *batch, size_t window) {
+	uring_batch_t state;
+	memset(&state, 0, sizeof(uring_batch_t));
+	state.batch = batch;
+
+	// Every file has at most two operations in flight, plus the close of the file that had its slot before
+	uint32_t entries = 8;
+	while (entries < window * 4) {
+		entries *= 2;
+	}
+
+	if (!uring_init(&state.ring, entries)) {
+		return 0;
+	}
+
+	state.number_of_slots = window;
+	state.files = mem_calloc(NULL, sizeof(uring_file_t) * window);
+	state.free_slots = mem_alloc(NULL, sizeof(size_t) * window);
+	if (!state.files || !state.free_slots) {
+		mem_free(NULL, state.files);
+		mem_free(NULL, state.free_slots);
+		uring_destroy(&state.ring);
+		return 0;
+	}
+
+	for (size_t i = 0; i < window; ++i) {
+		state.free_slots[state.number_of_free_slots++] = window - i - 1;
+	}
+
+	uint8_t failed = 0;
+	size_t next = 0;
+	while (next < batch->count || state.in_flight) {
+		while (next < batch->count && state.number_of_free_slots) {
+			uring_start_file(&state, next++);
+		}
+
+		if (!state.in_flight) {
+			continue;
+		}
+
+		if (!uring_submit_and_wait(&state.ring)) {
+			failed = 1;
+			break;
+		}
+
+		uint32_t head = *state.ring.cq_head;
+		uint32_t tail = __atomic_load_n(state.ring.cq_tail, __ATOMIC_ACQUIRE);
+
+		for (; head != tail; ++head) {
+			const struct io_uring_cqe *cqe = &state.ring.cqes[head & *state.ring.cq_mask];
+			uint64_t user_data = cqe->user_data;
+			int32_t result = cqe->res;
+
+			__atomic_store_n(state.ring.cq_head, head + 1, __ATOMIC_RELEASE);
+			uring_complete(&state, user_data, result);
+		}
+	}
+
+	uring_destroy(&state.ring);
+
+	if (failed) {
+		fail_uring_batch(&state, next);
+		return 1;
+	}
+
+	mem_free(NULL, state.files);
+	mem_free(NULL, state.free_slots);
+	return 1;
+}
+#endif
+
+EXPORT_SYM void ppelib_create_from_files(const char *const *paths, size_t count, size_t in_flight,
+		batch_callback_t callback, void *context) {
+	ppelib_reset_error();
+
+	batch_t batch = { 0 };
+	batch.paths = paths;
+	batch.count = count;
+	batch.callback = callback;
+	batch.context = context;
+
+	if (!init_lock(&batch.lock)) {
+		ppelib_set_error("Failed to initialize lock");
+		return;
+	}
+
+	size_t window = in_flight ? MIN(in_flight, count) : MIN(BATCH_DEFAULT_IN_FLIGHT, count);
+
+#ifdef PPELIB_HAVE_IO_URING
+	if (window && load_batch_uring(&batch, window)) {
+		destroy_lock(&batch.lock);
+		return;
+	}
+#endif
+
+	ppelib_executor_t executor = { NULL, NULL, window };
+	executor_run(&executor, batch_file_task, &batch, count);
+
+	destroy_lock(&batch.lock);
+}
@@ -53,18 +53,47 @@ EXPORT_SYM void ppelib_signature_remove(ppelib_file_t *pe) {
 		size_t offset = pe->header.data_directories[DIR_CERTIFICATE_TABLE].virtual_address - pe->end_of_sections;
 		size_t size = pe->header.data_directories[DIR_CERTIFICATE_TABLE].size;
 
-		if (buffer_excise(&pe->trailing_data, pe->trailing_data_size, offset, offset + size)) {
+		load_trailing_data(pe);
+		if (ppelib_error_peek()) {
+			return;
+		}
+
+		if (!buffer_make_owned(pe, &pe->trailing_data, pe->trailing_data_size)) {
+			return;
+		}
+
+		if (buffer_excise(pe, &pe->trailing_data, pe->trailing_data_size, offset, offset + size)) {
 			ppelib_set_error("Failed to resize trailing data");
 			return;
 		}
 
 		pe->trailing_data_size -= size;
+		invalidate_stats(&pe->overlay_stats);
 	}
 
-	ppelib_free_certificate_table(&pe->certificate_table);
+	ppelib_free_certificate_table(pe, &pe->certificate_table);
+	pe->certificate_table_parsed = 1;
+	pe->certificate_table_error = NULL;
 
 	memset(&pe->data_directories[DIR_CERTIFICATE_TABLE], 0, sizeof(ppelib_data_directory_t));
 	memset(&pe->header.data_directories[DIR_CERTIFICATE_TABLE], 0, sizeof(ppelib_header_data_directory_t));
 
 	ppelib_recalculate(pe);
 }
+
+void load_certificate_table(ppelib_file_t *pe) {
+	if (ppelib_has_signature(pe) && pe->reader.read_at && !pe->trailing_data) {
+		reader_load_certificate_table(pe);
+	} else if (ppelib_has_signature(pe)) {
+		deserialize_certificate_table(pe->trailing_data, pe->end_of_sections, pe->trailing_data_size, &pe->header,
+				&pe->certificate_table, buffer_is_borrowed(pe, pe->trailing_data), pe);
+	}
+}
+
+EXPORT_SYM ppelib_certificate_table_t* ppelib_get_certificate_table(ppelib_file_t *pe) {
+	ppelib_reset_error();
+
+	load_once(pe, &pe->certificate_table_parsed, &pe->certificate_table_error, load_certificate_table);
+
+	return &pe->certificate_table;
+}
@@ -0,0 +1,284 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-executor.h>
+
+#include "main.h"
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "utils.h"
+
+// The checksum is a ones' complement sum of 16 bit words. As 2^16 is 1 modulo 0xFFFF the words can just as well be
+// summed as 32 bit words into a wide accumulator and folded down to 16 bits once at the end.
+uint64_t checksum_words(uint64_t sum, const uint8_t *data, size_t size) {
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc0 = _mm_setzero_si128();
+	__m128i acc1 = _mm_setzero_si128();
+
+	while (size >= 32) {
+		__m128i v0 = _mm_loadu_si128((const __m128i*)data);
+		__m128i v1 = _mm_loadu_si128((const __m128i*)(data + 16));
+
+		acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+		acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+		acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+		acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+
+		data += 32;
+		size -= 32;
+	}
+
+	uint64_t lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(acc0, acc1));
+	sum += lanes[0] + lanes[1];
+#endif
+
+	while (size >= 8) {
+		uint64_t value = read_uint64_t(data);
+		sum += (value & 0xFFFFFFFF) + (value >> 32);
+
+		data += 8;
+		size -= 8;
+	}
+
+	if (size >= 4) {
+		sum += read_uint32_t(data);
+	}
+
+	return sum;
+}
+
+// Adds data found at offset in the file. Only the parity of offset matters.
+uint64_t checksum_add(uint64_t sum, const uint8_t *data, size_t size, size_t offset) {
+	if (!size) {
+		return sum;
+	}
+
+	if (offset & 1) {
+		sum += (uint64_t)data[0] << 8;
+		data++;
+		size--;
+	}
+
+	size_t words_size = size & ~(size_t)3;
+	sum = checksum_words(sum, data, words_size);
+	data += words_size;
+	size -= words_size;
+
+	if (size >= 2) {
+		sum += read_uint16_t(data);
+		data += 2;
+		size -= 2;
+	}
+
+	if (size) {
+		sum += data[0];
+	}
+
+	return sum;
+}
+
+uint32_t checksum_finish(uint64_t sum, size_t size) {
+	while (sum >> 16) {
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+
+	return (uint32_t)(sum + size);
+}
+
+size_t checksum_field_offset(size_t pe_header_offset) {
+	return pe_header_offset + 4 + COFF_HEADER_SIZE + PE_CHECKSUM_OFFSET;
+}
+
+// Writes smaller than this aren't worth spreading over several threads
+#define CHECKSUM_PARALLEL_SIZE (4 * 1024 * 1024)
+#define CHECKSUM_MAX_CHUNKS 256
+
+typedef struct checksum_chunks {
+	const uint8_t *data;
+	size_t size;
+	size_t offset;
+	size_t chunk_size;
+
+	uint64_t sums[CHECKSUM_MAX_CHUNKS];
+} checksum_chunks_t;
+
+void checksum_chunk_task(void *argument, size_t index) {
+	checksum_chunks_t *chunks = argument;
+	size_t start = index * chunks->chunk_size;
+	size_t size = MIN(chunks->chunk_size, chunks->size - start);
+
+	chunks->sums[index] = checksum_add(0, chunks->data + start, size, chunks->offset + start);
+}
+
+// Summing is associative, so the chunks are summed separately and the partial sums added up pairwise afterwards.
+// Even a 4 GB image sums to less than 2^62, the partial sums can't overflow.
+uint64_t checksum_add_parallel(uint64_t sum, const uint8_t *data, size_t size, size_t offset,
+		const ppelib_executor_t *executor) {
+	size_t concurrency = executor_concurrency(executor);
+	if (concurrency == 1 || size < CHECKSUM_PARALLEL_SIZE) {
+		return checksum_add(sum, data, size, offset);
+	}
+
+	checksum_chunks_t chunks;
+	chunks.data = data;
+	chunks.size = size;
+	chunks.offset = offset;
+
+	// A few chunks per thread keeps them all busy when some run slower, multiples of 64 bytes keep the words aligned
+	size_t number_of_chunks = MIN(concurrency * 4, CHECKSUM_MAX_CHUNKS);
+	chunks.chunk_size = TO_NEAREST((size + number_of_chunks - 1) / number_of_chunks, 64);
+	number_of_chunks = (size + chunks.chunk_size - 1) / chunks.chunk_size;
+
+	executor_run(executor, checksum_chunk_task, &chunks, number_of_chunks);
+
+	for (size_t stride = 1; stride < number_of_chunks; stride *= 2) {
+		for (size_t i = 0; i + stride < number_of_chunks; i += stride * 2) {
+			chunks.sums[i] += chunks.sums[i + stride];
+		}
+	}
+
+	return sum + chunks.sums[0];
+}
+
+typedef struct checksum_sink {
+	uint64_t sum;
+	size_t field_offset;
+	const ppelib_executor_t *executor;
+} checksum_sink_t;
+
+// Sums everything except the checksum field itself. Ranges of zeroes don't change the sum.
+size_t checksum_sink_write(void *context, size_t offset, const uint8_t *data, size_t size) {
+	checksum_sink_t *checksum = context;
+	if (!data) {
+		return size;
+	}
+
+	size_t field_start = checksum->field_offset;
+	size_t field_end = field_start + sizeof(uint32_t);
+
+	if (offset >= field_end || offset + size <= field_start) {
+		checksum->sum = checksum_add_parallel(checksum->sum, data, size, offset, checksum->executor);
+		return size;
+	}
+
+	if (offset < field_start) {
+		checksum->sum = checksum_add_parallel(checksum->sum, data, field_start - offset, offset,
+				checksum->executor);
+	}
+
+	if (offset + size > field_end) {
+		size_t skip = field_end - offset;
+		checksum->sum = checksum_add_parallel(checksum->sum, data + skip, size - skip, field_end,
+				checksum->executor);
+	}
+
+	return size;
+}
+
+// Streams the image as it would be written through the checksum instead of building it in memory
+uint32_t compute_checksum(ppelib_file_t *pe, const ppelib_executor_t *executor) {
+	checksum_sink_t checksum = { 0, checksum_field_offset(pe->pe_header_offset), executor };
+	ppelib_sink_t sink = { checksum_sink_write, &checksum };
+
+	size_t size = write_image(pe, &sink);
+	if (ppelib_error_peek()) {
+		return 0;
+	}
+
+	return checksum_finish(checksum.sum, size);
+}
+
+// Sums a whole file in memory
+uint32_t compute_buffer_checksum(const uint8_t *buffer, size_t size, size_t pe_header_offset) {
+	checksum_sink_t checksum = { 0, checksum_field_offset(pe_header_offset), NULL };
+
+	checksum_sink_write(&checksum, 0, buffer, size);
+	return checksum_finish(checksum.sum, size);
+}
+
+// Sums the file the handle was loaded from, which unlike the image as written includes the slack between the end of
+// section data and the end of the raw section. Handles that copied the file have it summed while loading. Returns 0
+// when the handle has no file to read from.
+uint8_t compute_file_checksum(ppelib_file_t *pe, const ppelib_executor_t *executor, uint32_t *retval) {
+	if (pe->file_checksum_known) {
+		*retval = pe->file_checksum;
+		return 1;
+	}
+
+	size_t pe_header_offset = pe->original_headers_size ? pe->original_pe_header_offset : pe->pe_header_offset;
+	checksum_sink_t checksum = { 0, checksum_field_offset(pe_header_offset), executor };
+	ppelib_sink_t sink = { checksum_sink_write, &checksum };
+
+	if (!stream_original_file(pe, &sink, executor)) {
+		return 0;
+	}
+
+	*retval = checksum_finish(checksum.sum, pe->file_buffer ? pe->file_buffer_size : pe->reader.size);
+	return 1;
+}
+
+uint8_t verify_checksum(ppelib_file_t *pe, const ppelib_executor_t *executor) {
+	uint32_t checksum;
+	if (!compute_file_checksum(pe, executor, &checksum)) {
+		if (ppelib_error_peek()) {
+			return 0;
+		}
+
+		checksum = compute_checksum(pe, executor);
+		if (ppelib_error_peek()) {
+			return 0;
+		}
+	}
+
+	return checksum == pe->header.checksum;
+}
+
+EXPORT_SYM uint32_t ppelib_compute_checksum(ppelib_file_t *pe) {
+	ppelib_reset_error();
+
+	return compute_checksum(pe, NULL);
+}
+
+EXPORT_SYM uint32_t ppelib_compute_checksum_with_executor(ppelib_file_t *pe, const ppelib_executor_t *executor) {
+	ppelib_reset_error();
+
+	return compute_checksum(pe, executor);
+}
+
+EXPORT_SYM uint8_t ppelib_verify_checksum(ppelib_file_t *pe) {
+	ppelib_reset_error();
+
+	return verify_checksum(pe, NULL);
+}
+
+EXPORT_SYM uint8_t ppelib_verify_checksum_with_executor(ppelib_file_t *pe, const ppelib_executor_t *executor) {
+	ppelib_reset_error();
+
+	return verify_checksum(pe, executor);
+}
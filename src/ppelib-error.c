@@ -36,6 +36,14 @@ void ppelib_set_error_func(const char* function, const char* error) {
 	ppelib_cur_error = ppelib_error_str;
 }
 
+// Sets an error kept from earlier as is, it already has its function name
+void ppelib_restore_error(const char* error) {
+	strncpy(ppelib_error_str, error, 99);
+	ppelib_error_str[99] = '\0';
+
+	ppelib_cur_error = ppelib_error_str;
+}
+
 void ppelib_reset_error() {
 	ppelib_cur_error = NULL;
 }
@@ -26,6 +26,7 @@ const char* ppelib_error();
 
 void ppelib_set_error_func(const char* function, const char* error);
 void ppelib_reset_error();
+void ppelib_restore_error(const char* error);
 
 uint32_t ppelib_error_peek();
 
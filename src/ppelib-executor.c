@@ -0,0 +1,129 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <ppelib/ppelib-executor.h>
+
+#include "ppelib-internal.h"
+#include "main.h"
+#include "utils.h"
+
+#define EXECUTOR_MAX_THREADS 64
+
+typedef struct worker_set {
+	void (*task)(void *argument, size_t index);
+	void *argument;
+	size_t count;
+
+	atomic_size_t next;
+} worker_set_t;
+
+void run_worker(worker_set_t *workers) {
+	size_t index;
+	while ((index = atomic_fetch_add(&workers->next, 1)) < workers->count) {
+		workers->task(workers->argument, index);
+	}
+}
+
+#ifdef _WIN32
+DWORD WINAPI worker_thread(LPVOID context) {
+	run_worker(context);
+	return 0;
+}
+#else
+void* worker_thread(void *context) {
+	run_worker(context);
+	return NULL;
+}
+#endif
+
+// Starts a thread for every task that can run at once besides the calling one, which works too. When a thread can't
+// be started its share is picked up by the others.
+void run_worker_set(size_t concurrency, void (*task)(void *argument, size_t index), void *argument, size_t count) {
+	worker_set_t workers = { task, argument, count, 0 };
+
+	size_t number_of_threads = MIN(MIN(concurrency, count), EXECUTOR_MAX_THREADS) - 1;
+	size_t started = 0;
+
+#ifdef _WIN32
+	HANDLE threads[EXECUTOR_MAX_THREADS];
+	for (; started < number_of_threads; ++started) {
+		threads[started] = CreateThread(NULL, 0, worker_thread, &workers, 0, NULL);
+		if (!threads[started]) {
+			break;
+		}
+	}
+
+	run_worker(&workers);
+
+	for (size_t i = 0; i < started; ++i) {
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+#else
+	pthread_t threads[EXECUTOR_MAX_THREADS];
+	for (; started < number_of_threads; ++started) {
+		if (pthread_create(&threads[started], NULL, worker_thread, &workers)) {
+			break;
+		}
+	}
+
+	run_worker(&workers);
+
+	for (size_t i = 0; i < started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+#endif
+}
+
+size_t executor_concurrency(const ppelib_executor_t *executor) {
+	if (!executor || !executor->concurrency) {
+		return 1;
+	}
+
+	return executor->concurrency;
+}
+
+// Tasks must not set errors, those are per thread and would be lost
+void executor_run(const ppelib_executor_t *executor, void (*task)(void *argument, size_t index), void *argument,
+		size_t count) {
+	size_t concurrency = executor_concurrency(executor);
+
+	if (concurrency == 1 || count < 2) {
+		for (size_t i = 0; i < count; ++i) {
+			task(argument, i);
+		}
+		return;
+	}
+
+	if (executor->run) {
+		executor->run(executor->context, task, argument, count);
+		return;
+	}
+
+	run_worker_set(concurrency, task, argument, count);
+}
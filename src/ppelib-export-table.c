@@ -0,0 +1,226 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-export-table.h>
+
+#include "main.h"
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "utils.h"
+
+#define EXPORT_DIRECTORY_SIZE 40
+
+int compare_export_names(const void *a, const void *b) {
+	const ppelib_export_name_t *na = a;
+	const ppelib_export_name_t *nb = b;
+
+	return strcmp(na->name, nb->name);
+}
+
+// Returns a pointer to count entries of entry_size bytes at rva, or NULL if they don't all fit in the section
+const uint8_t* export_array(ppelib_file_t *pe, size_t rva, size_t count, size_t entry_size) {
+	size_t available;
+	const uint8_t *data = rva_to_pointer(pe, rva, &available);
+	if (!data || count > available / entry_size) {
+		return NULL;
+	}
+
+	return data;
+}
+
+void parse_export_table(ppelib_file_t *pe) {
+	ppelib_export_table_t *table = &pe->export_table;
+	memset(table, 0, sizeof(ppelib_export_table_t));
+
+	size_t table_rva = pe->header.data_directories[DIR_EXPORT_TABLE].virtual_address;
+	size_t table_size = pe->header.data_directories[DIR_EXPORT_TABLE].size;
+
+	const uint8_t *directory = export_array(pe, table_rva, 1, EXPORT_DIRECTORY_SIZE);
+	if (!directory) {
+		if (!ppelib_error_peek()) {
+			ppelib_set_error("Export directory outside of section");
+		}
+		return;
+	}
+
+	table->characteristics = read_uint32_t(directory + 0);
+	table->time_date_stamp = read_uint32_t(directory + 4);
+	table->major_version = read_uint16_t(directory + 8);
+	table->minor_version = read_uint16_t(directory + 10);
+	uint32_t name_rva = read_uint32_t(directory + 12);
+	table->ordinal_base = read_uint32_t(directory + 16);
+	uint32_t number_of_addresses = read_uint32_t(directory + 20);
+	uint32_t number_of_names = read_uint32_t(directory + 24);
+	uint32_t address_table_rva = read_uint32_t(directory + 28);
+	uint32_t name_pointer_table_rva = read_uint32_t(directory + 32);
+	uint32_t ordinal_table_rva = read_uint32_t(directory + 36);
+
+	size_t name_size;
+	table->name = name_rva ? rva_to_string(pe, name_rva, &name_size) : NULL;
+
+	const uint8_t *address_table = export_array(pe, address_table_rva, number_of_addresses, sizeof(uint32_t));
+	const uint8_t *name_pointer_table = export_array(pe, name_pointer_table_rva, number_of_names, sizeof(uint32_t));
+	const uint8_t *ordinal_table = export_array(pe, ordinal_table_rva, number_of_names, sizeof(uint16_t));
+	if (ppelib_error_peek()) {
+		memset(table, 0, sizeof(ppelib_export_table_t));
+		return;
+	}
+
+	if ((number_of_addresses && !address_table) || (number_of_names && (!name_pointer_table || !ordinal_table))) {
+		ppelib_set_error("Export tables outside of section");
+		memset(table, 0, sizeof(ppelib_export_table_t));
+		return;
+	}
+
+	table->addresses = arena_alloc(&pe->arena, sizeof(uint32_t) * number_of_addresses);
+	table->names = arena_alloc(&pe->arena, sizeof(ppelib_export_name_t) * number_of_names);
+	pe->export_names_by_address = arena_calloc(&pe->arena, sizeof(char*) * number_of_addresses);
+	if (!table->addresses || !table->names || !pe->export_names_by_address) {
+		ppelib_set_error("Failed to allocate export table");
+		memset(table, 0, sizeof(ppelib_export_table_t));
+		return;
+	}
+
+	for (uint32_t i = 0; i < number_of_addresses; ++i) {
+		table->addresses[i] = read_uint32_t(address_table + (i * sizeof(uint32_t)));
+	}
+	table->number_of_addresses = number_of_addresses;
+
+	uint8_t sorted = 1;
+	for (uint32_t i = 0; i < number_of_names; ++i) {
+		ppelib_export_name_t *name = &table->names[i];
+
+		name->name = rva_to_string(pe, read_uint32_t(name_pointer_table + (i * sizeof(uint32_t))), &name_size);
+		name->address_index = read_uint16_t(ordinal_table + (i * sizeof(uint16_t)));
+		if (!name->name || name->address_index >= number_of_addresses) {
+			if (!ppelib_error_peek()) {
+				ppelib_set_error("Invalid export name");
+			}
+			memset(table, 0, sizeof(ppelib_export_table_t));
+			return;
+		}
+
+		if (!pe->export_names_by_address[name->address_index]) {
+			pe->export_names_by_address[name->address_index] = name->name;
+		}
+
+		if (i && strcmp(table->names[i - 1].name, name->name) > 0) {
+			sorted = 0;
+		}
+	}
+	table->number_of_names = number_of_names;
+
+	// The loader binary searches this table too, so it's sorted in anything that loads. Just in case.
+	if (!sorted) {
+		qsort(table->names, number_of_names, sizeof(ppelib_export_name_t), compare_export_names);
+	}
+
+	pe->export_table_start = table_rva;
+	pe->export_table_end = table_rva + table_size;
+}
+
+ppelib_export_t export_at(ppelib_file_t *pe, uint32_t address_index) {
+	const ppelib_export_table_t *table = &pe->export_table;
+	ppelib_export_t retval = { 0 };
+
+	retval.ordinal = table->ordinal_base + address_index;
+	retval.address = table->addresses[address_index];
+	retval.name = pe->export_names_by_address[address_index];
+
+	// Forwarded exports point at a string inside the export directory instead of at code
+	if (retval.address >= pe->export_table_start && retval.address < pe->export_table_end) {
+		size_t size;
+		retval.forwarder = rva_to_string(pe, retval.address, &size);
+	}
+
+	return retval;
+}
+
+void load_export_table(ppelib_file_t *pe) {
+	if (pe->header.number_of_rva_and_sizes > DIR_EXPORT_TABLE) {
+		if (pe->header.data_directories[DIR_EXPORT_TABLE].size) {
+			parse_export_table(pe);
+		}
+	}
+}
+
+EXPORT_SYM ppelib_export_table_t* ppelib_get_export_table(ppelib_file_t *pe) {
+	ppelib_reset_error();
+
+	load_once(pe, &pe->export_table_parsed, &pe->export_table_error, load_export_table);
+
+	return &pe->export_table;
+}
+
+EXPORT_SYM ppelib_export_t ppelib_export_find_by_name(ppelib_file_t *pe, const char *name) {
+	ppelib_reset_error();
+
+	ppelib_export_t retval = { 0 };
+
+	const ppelib_export_table_t *table = ppelib_get_export_table(pe);
+	if (ppelib_error_peek()) {
+		return retval;
+	}
+
+	size_t low = 0;
+	size_t high = table->number_of_names;
+
+	while (low < high) {
+		size_t mid = low + ((high - low) / 2);
+		int cmp = strcmp(table->names[mid].name, name);
+
+		if (cmp == 0) {
+			return export_at(pe, table->names[mid].address_index);
+		}
+
+		if (cmp < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	ppelib_set_error("Export not found");
+	return retval;
+}
+
+EXPORT_SYM ppelib_export_t ppelib_export_find_by_ordinal(ppelib_file_t *pe, uint32_t ordinal) {
+	ppelib_reset_error();
+
+	ppelib_export_t retval = { 0 };
+
+	const ppelib_export_table_t *table = ppelib_get_export_table(pe);
+	if (ppelib_error_peek()) {
+		return retval;
+	}
+
+	// Unused slots in the address table are 0
+	uint32_t address_index = ordinal - table->ordinal_base;
+	if (ordinal < table->ordinal_base || address_index >= table->number_of_addresses
+			|| !table->addresses[address_index]) {
+		ppelib_set_error("Export not found");
+		return retval;
+	}
+
+	return export_at(pe, address_index);
+}
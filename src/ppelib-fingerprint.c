@@ -0,0 +1,264 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-fingerprint.h>
+
+#include "main.h"
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "utils.h"
+
+#define RICH_HEADER_START 0x80
+#define RICH_SIGNATURE 0x68636952
+#define DANS_SIGNATURE 0x536E6144
+
+typedef struct section_fingerprints {
+	ppelib_file_t *pe;
+	uint32_t flags;
+
+	const uint8_t *contents[PE_MAX_SECTIONS];
+	ppelib_section_fingerprint_t *fingerprints;
+} section_fingerprints_t;
+
+char ascii_lowercase(char c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+void hash_lowercase(hash_context_t *context, const char *string, size_t size) {
+	uint8_t buffer[HASH_BLOCK_SIZE];
+
+	while (size) {
+		size_t chunk = MIN(size, sizeof(buffer));
+		for (size_t i = 0; i < chunk; ++i) {
+			buffer[i] = ascii_lowercase(string[i]);
+		}
+
+		hash_update(context, buffer, chunk);
+		string += chunk;
+		size -= chunk;
+	}
+}
+
+// The extension of the DLL name is left out when it is one of the usual ones
+size_t imphash_library_name_size(const char *name) {
+	size_t size = strlen(name);
+	const char *extension = strrchr(name, '.');
+	if (!extension || strlen(extension) != 4) {
+		return size;
+	}
+
+	char lowercase[5] = { 0 };
+	for (size_t i = 0; i < 4; ++i) {
+		lowercase[i] = ascii_lowercase(extension[i]);
+	}
+
+	if (strcmp(lowercase, ".dll") == 0 || strcmp(lowercase, ".ocx") == 0 || strcmp(lowercase, ".sys") == 0) {
+		return extension - name;
+	}
+
+	return size;
+}
+
+uint8_t fingerprint_imphash(ppelib_file_t *pe, uint8_t *digest) {
+	const ppelib_import_table_t *table = ppelib_get_import_table(pe);
+	if (ppelib_error_peek() || !table->number_of_symbols) {
+		return 0;
+	}
+
+	hash_context_t context;
+	hash_init(&context, PPELIB_DIGEST_MD5);
+
+	uint8_t first = 1;
+	for (size_t i = 0; i < table->number_of_descriptors; ++i) {
+		const ppelib_import_descriptor_t *descriptor = &table->descriptors[i];
+		const char *library = table->strings + descriptor->name;
+		size_t library_size = imphash_library_name_size(library);
+
+		for (size_t j = 0; j < descriptor->number_of_symbols; ++j) {
+			const ppelib_import_symbol_t *symbol = &table->symbols[descriptor->first_symbol + j];
+
+			if (!first) {
+				hash_update(&context, (const uint8_t*)",", 1);
+			}
+			first = 0;
+
+			hash_lowercase(&context, library, library_size);
+			hash_update(&context, (const uint8_t*)".", 1);
+
+			const char *name = symbol->by_ordinal ? ordinal_name(library, symbol->ordinal) : table->strings + symbol->name;
+			if (name) {
+				hash_lowercase(&context, name, strlen(name));
+			} else {
+				char ordinal[16];
+				int size = snprintf(ordinal, sizeof(ordinal), "ord%u", symbol->ordinal);
+				hash_update(&context, (const uint8_t*)ordinal, size);
+			}
+		}
+	}
+
+	hash_final(&context, digest);
+	return 1;
+}
+
+uint8_t fingerprint_rich_header(ppelib_file_t *pe, uint8_t *digest) {
+	const uint8_t *stub = pe->stub;
+	size_t stub_size = pe->pe_header_offset;
+
+	// The Rich marker is followed by the XOR key, the DanS marker is the first dword of the header once decoded
+	size_t rich = 0;
+	for (size_t offset = RICH_HEADER_START; offset + 8 <= stub_size; offset += 4) {
+		if (read_uint32_t(stub + offset) == RICH_SIGNATURE) {
+			rich = offset;
+			break;
+		}
+	}
+
+	if (!rich) {
+		return 0;
+	}
+
+	uint32_t key = read_uint32_t(stub + rich + 4);
+
+	size_t dans = rich;
+	while (dans > RICH_HEADER_START) {
+		dans -= 4;
+		if ((read_uint32_t(stub + dans) ^ key) == DANS_SIGNATURE) {
+			break;
+		}
+	}
+
+	if ((read_uint32_t(stub + dans) ^ key) != DANS_SIGNATURE) {
+		return 0;
+	}
+
+	hash_context_t context;
+	hash_init(&context, PPELIB_DIGEST_MD5);
+
+	for (size_t offset = dans; offset < rich; offset += 4) {
+		uint8_t decoded[4];
+		write_uint32_t(decoded, read_uint32_t(stub + offset) ^ key);
+		hash_update(&context, decoded, sizeof(decoded));
+	}
+
+	hash_final(&context, digest);
+	return 1;
+}
+
+// Both digests are computed in the same pass over the section so it is only read once. The contents must be loaded
+// already, nothing here sets errors so it can run on any thread.
+void fingerprint_section(const ppelib_section_t *section, const uint8_t *contents, uint32_t flags,
+		ppelib_section_fingerprint_t *fingerprint) {
+	static const uint8_t zeroes[HASH_BLOCK_SIZE * 16];
+
+	hash_context_t md5;
+	hash_context_t sha256;
+	hash_init(&md5, PPELIB_DIGEST_MD5);
+	hash_init(&sha256, PPELIB_DIGEST_SHA256);
+
+	size_t data_size = contents ? MIN(section->virtual_size, section->size_of_raw_data) : 0;
+	for (size_t offset = 0; offset < section->size_of_raw_data;) {
+		const uint8_t *data = zeroes;
+		size_t size = MIN(section->size_of_raw_data - offset, sizeof(zeroes));
+		if (offset < data_size) {
+			data = contents + offset;
+			size = MIN(data_size - offset, sizeof(zeroes));
+		}
+
+		if (flags & PPELIB_FINGERPRINT_SECTION_MD5) {
+			hash_update(&md5, data, size);
+		}
+		if (flags & PPELIB_FINGERPRINT_SECTION_SHA256) {
+			hash_update(&sha256, data, size);
+		}
+
+		offset += size;
+	}
+
+	if (flags & PPELIB_FINGERPRINT_SECTION_MD5) {
+		hash_final(&md5, fingerprint->md5);
+	}
+	if (flags & PPELIB_FINGERPRINT_SECTION_SHA256) {
+		hash_final(&sha256, fingerprint->sha256);
+	}
+}
+
+void fingerprint_section_task(void *argument, size_t index) {
+	section_fingerprints_t *sections = argument;
+
+	fingerprint_section(sections->pe->sections[index], sections->contents[index], sections->flags,
+			&sections->fingerprints[index]);
+}
+
+EXPORT_SYM uint32_t ppelib_fingerprint_with_executor(ppelib_file_t *pe, uint32_t flags,
+		ppelib_fingerprint_t *fingerprint, const ppelib_executor_t *executor) {
+	ppelib_reset_error();
+
+	memset(fingerprint, 0, sizeof(ppelib_fingerprint_t));
+	uint32_t computed = 0;
+
+	if (flags & PPELIB_FINGERPRINT_IMPHASH) {
+		if (fingerprint_imphash(pe, fingerprint->imphash)) {
+			computed |= PPELIB_FINGERPRINT_IMPHASH;
+		}
+		if (ppelib_error_peek()) {
+			return 0;
+		}
+	}
+
+	if (flags & PPELIB_FINGERPRINT_RICH_HEADER) {
+		if (fingerprint_rich_header(pe, fingerprint->rich_header_hash)) {
+			computed |= PPELIB_FINGERPRINT_RICH_HEADER;
+		}
+	}
+
+	uint32_t section_flags = flags & (PPELIB_FINGERPRINT_SECTION_MD5 | PPELIB_FINGERPRINT_SECTION_SHA256);
+	if (section_flags && pe->header.number_of_sections) {
+		fingerprint->number_of_sections = MIN(pe->header.number_of_sections, PE_MAX_SECTIONS);
+
+		section_fingerprints_t sections;
+		sections.pe = pe;
+		sections.flags = section_flags;
+		sections.fingerprints = fingerprint->sections;
+
+		// Loaded up front on this thread, which takes the lock for reader handles and can report errors
+		for (size_t i = 0; i < fingerprint->number_of_sections; ++i) {
+			sections.contents[i] = load_section_contents(pe, pe->sections[i]);
+			if (ppelib_error_peek()) {
+				memset(fingerprint, 0, sizeof(ppelib_fingerprint_t));
+				return 0;
+			}
+		}
+
+		executor_run(executor, fingerprint_section_task, &sections, fingerprint->number_of_sections);
+
+		computed |= section_flags;
+	}
+
+	return computed;
+}
+
+EXPORT_SYM uint32_t ppelib_fingerprint(ppelib_file_t *pe, uint32_t flags, ppelib_fingerprint_t *fingerprint) {
+	ppelib_reset_error();
+
+	return ppelib_fingerprint_with_executor(pe, flags, fingerprint, NULL);
+}
@@ -15,75 +15,317 @@
  * limitations under the License.
  */
 
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <ppelib/ppelib-constants.h>
 #include <ppelib-error.h>
 #include <ppelib-internal.h>
 #include "export.h"
 #include "main.h"
 
-EXPORT_SYM ppelib_file_t* ppelib_create() {
+// Recursive, so anything that runs under the lock can call into code that takes it again
+uint8_t init_lock(ppelib_lock_t *lock) {
+#ifdef _WIN32
+	InitializeCriticalSection(lock);
+	return 1;
+#else
+	pthread_mutexattr_t attributes;
+	if (pthread_mutexattr_init(&attributes)) {
+		return 0;
+	}
+
+	int retval = pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+	if (!retval) {
+		retval = pthread_mutex_init(lock, &attributes);
+	}
+
+	pthread_mutexattr_destroy(&attributes);
+	return retval == 0;
+#endif
+}
+
+void destroy_lock(ppelib_lock_t *lock) {
+#ifdef _WIN32
+	DeleteCriticalSection(lock);
+#else
+	pthread_mutex_destroy(lock);
+#endif
+}
+
+void acquire_lock(ppelib_lock_t *lock) {
+#ifdef _WIN32
+	EnterCriticalSection(lock);
+#else
+	pthread_mutex_lock(lock);
+#endif
+}
+
+void release_lock(ppelib_lock_t *lock) {
+#ifdef _WIN32
+	LeaveCriticalSection(lock);
+#else
+	pthread_mutex_unlock(lock);
+#endif
+}
+
+void lock_file(ppelib_file_t *pe) {
+	acquire_lock(&pe->lock);
+}
+
+void unlock_file(ppelib_file_t *pe) {
+	release_lock(&pe->lock);
+}
+
+// Copy of the current error that lives as long as the handle, or NULL when there is none
+const char* keep_load_error(ppelib_file_t *pe) {
+	const char *error = ppelib_error();
+	if (!error) {
+		return NULL;
+	}
+
+	size_t size = strlen(error) + 1;
+	char *kept = arena_alloc(&pe->arena, size);
+	if (!kept) {
+		// The arena set its own error, which is kept in place of the original
+		return "keep_load_error(): Failed to allocate error";
+	}
+
+	memcpy(kept, error, size);
+	return kept;
+}
+
+// Runs load the first time it is called for the flag. Once the flag is set the lock is skipped entirely, other callers
+// that come in while the first one is still loading wait for it to finish. An error from load is kept in error and
+// set again for every caller, so all of them see the same result.
+void load_once(ppelib_file_t *pe, atomic_uchar *loaded, const char **error, void (*load)(ppelib_file_t *pe)) {
+	if (!atomic_load_explicit(loaded, memory_order_acquire)) {
+		lock_file(pe);
+		if (!atomic_load_explicit(loaded, memory_order_relaxed)) {
+			load(pe);
+			*error = keep_load_error(pe);
+			atomic_store_explicit(loaded, 1, memory_order_release);
+		}
+		unlock_file(pe);
+	}
+
+	if (*error) {
+		ppelib_restore_error(*error);
+	}
+}
+
+EXPORT_SYM ppelib_file_t* ppelib_create_with_allocator(const ppelib_allocator_t *allocator) {
 	ppelib_reset_error();
 
-	ppelib_file_t *pe = calloc(sizeof(ppelib_file_t), 1);
+	if (!allocator->alloc || !allocator->realloc || !allocator->free) {
+		ppelib_set_error("Incomplete allocator");
+		return NULL;
+	}
+
+	ppelib_file_t *pe = allocator->alloc(allocator->context, sizeof(ppelib_file_t));
 	if (!pe) {
 		ppelib_set_error("Failed to allocate PE structure");
+		return NULL;
+	}
+
+	memset(pe, 0, sizeof(ppelib_file_t));
+	pe->allocator = *allocator;
+	pe->arena.allocator = &pe->allocator;
+
+	if (!init_lock(&pe->lock)) {
+		ppelib_set_error("Failed to initialize lock");
+		allocator->free(allocator->context, pe);
+		return NULL;
 	}
 
 	return pe;
 }
 
-EXPORT_SYM void ppelib_destroy(ppelib_file_t *pe) {
-	if (!pe) {
-		return;
-	}
+EXPORT_SYM ppelib_file_t* ppelib_create() {
+	return ppelib_create_with_allocator(get_allocator(NULL));
+}
 
-	ppelib_free_certificate_table(&pe->certificate_table);
+// Releases everything that belongs to the loaded file
+void free_file_contents(ppelib_file_t *pe) {
+	ppelib_free_certificate_table(pe, &pe->certificate_table);
 	free_resource_directory(pe);
 
-	free(pe->stub);
+	buffer_free(pe, pe->stub);
 	if (pe->allocated_sections) {
 		for (size_t i = 0; i < pe->header.number_of_sections; ++i) {
-			free(pe->sections[i]->contents);
-			free(pe->sections[i]);
+			buffer_free(pe, pe->sections[i]->contents);
 		}
 	}
-	free(pe->data_directories);
-	free(pe->header.data_directories);
-	free(pe->sections);
-	free(pe->trailing_data);
+	buffer_free(pe, pe->trailing_data);
+	free_block_cache(pe);
 
-	free(pe);
+#ifndef _WIN32
+	if (pe->file_buffer_mapped) {
+		munmap((void*)pe->file_buffer, pe->file_buffer_size);
+	}
+#endif
+	if (pe->file_buffer_owned) {
+		mem_free(pe, (void*)pe->file_buffer);
+	}
 }
 
-EXPORT_SYM ppelib_file_t* ppelib_create_from_buffer(const uint8_t *buffer, size_t size) {
+EXPORT_SYM void ppelib_destroy(ppelib_file_t *pe) {
+	if (!pe) {
+		return;
+	}
+
+	free_file_contents(pe);
+	mem_free(pe, pe->original_headers);
+	mem_free(pe, pe->dirty_ranges);
+	arena_destroy(&pe->arena);
+	destroy_lock(&pe->lock);
+
+	ppelib_allocator_t allocator = pe->allocator;
+	allocator.free(allocator.context, pe);
+}
+
+// Returns the handle to its empty state while keeping the arena and other buffers for reuse
+void reset_file(ppelib_file_t *pe) {
+	free_file_contents(pe);
+	arena_reset(&pe->arena);
+
+	ppelib_allocator_t allocator = pe->allocator;
+	ppelib_arena_chunk_t *chunks = pe->arena.chunks;
+	uint8_t *original_headers = pe->original_headers;
+	size_t allocated_original_headers = pe->allocated_original_headers;
+	ppelib_range_t *dirty_ranges = pe->dirty_ranges;
+	size_t allocated_dirty_ranges = pe->allocated_dirty_ranges;
+
+	// Everything but the lock, which can't be copied and stays initialized
+	size_t lock_end = offsetof(ppelib_file_t, lock) + sizeof(ppelib_lock_t);
+	memset(pe, 0, offsetof(ppelib_file_t, lock));
+	memset((uint8_t*)pe + lock_end, 0, sizeof(ppelib_file_t) - lock_end);
+
+	pe->allocator = allocator;
+	pe->arena.allocator = &pe->allocator;
+	pe->arena.chunks = chunks;
+	pe->original_headers = original_headers;
+	pe->allocated_original_headers = allocated_original_headers;
+	pe->dirty_ranges = dirty_ranges;
+	pe->allocated_dirty_ranges = allocated_dirty_ranges;
+}
+
+EXPORT_SYM void ppelib_reset(ppelib_file_t *pe) {
 	ppelib_reset_error();
 
+	reset_file(pe);
+}
+
+EXPORT_SYM void ppelib_load_into(ppelib_file_t *pe, const uint8_t *buffer, size_t size) {
+	ppelib_reset(pe);
+
+	load_from_buffer(pe, buffer, size, 0);
+	if (ppelib_error_peek()) {
+		reset_file(pe);
+	}
+}
+
+// Borrowed buffers point into the file buffer or the handle's arena and are never freed individually
+uint8_t buffer_is_borrowed(const ppelib_file_t *pe, const void *ptr) {
+	if (!ptr) {
+		return 0;
+	}
+
+	const uint8_t *p = ptr;
+	if (pe->file_buffer && p >= pe->file_buffer && p <= pe->file_buffer + pe->file_buffer_size) {
+		return 1;
+	}
+
+	return arena_owns(&pe->arena, ptr);
+}
+
+void buffer_free(const ppelib_file_t *pe, void *ptr) {
+	if (buffer_is_borrowed(pe, ptr)) {
+		return;
+	}
+
+	mem_free(pe, ptr);
+}
+
+// Gives the handle its own copy of a buffer that still points into the file buffer, so it can be modified or
+// reallocated.
+uint8_t* buffer_make_owned(const ppelib_file_t *pe, uint8_t **ptr, size_t size) {
+	if (!buffer_is_borrowed(pe, *ptr)) {
+		return *ptr;
+	}
+
+	uint8_t *owned = mem_alloc(pe, size);
+	if (!owned) {
+		ppelib_set_error("Failed to allocate buffer copy");
+		return NULL;
+	}
+
+	memcpy(owned, *ptr, size);
+	*ptr = owned;
+
+	return owned;
+}
+
+uint16_t buffer_excise(const ppelib_file_t *pe, uint8_t **buffer, size_t size, size_t start, size_t end) {
+	if (start >= end) {
+		return 1;
+	}
+
+	if (end != size) {
+		memmove((*buffer) + start, (*buffer) + end, size - end);
+	}
+
+	uint8_t *oldptr = *buffer;
+	*buffer = mem_realloc(pe, *buffer, size - (end - start));
+	if (!*buffer) {
+		*buffer = oldptr;
+		return 1;
+	}
+
+	return 0;
+}
+
+uint32_t read_pe_header_offset(const uint8_t *buffer, size_t size) {
 	if (size < PE_SIGNATURE_OFFSET + sizeof(uint32_t)) {
 		ppelib_set_error("Not a PE file (file too small)");
-		return NULL;
+		return 0;
 	}
 
 	uint32_t header_offset = read_uint32_t(buffer + PE_SIGNATURE_OFFSET);
 	if (size < header_offset + sizeof(uint32_t)) {
 		ppelib_set_error("Not a PE file (file too small for PE signature)");
-		return NULL;
+		return 0;
 	}
 
 	uint32_t signature = read_uint32_t(buffer + header_offset);
 	if (signature != PE_SIGNATURE) {
 		ppelib_set_error("Not a PE file (PE00 signature missing)");
-		return NULL;
+		return 0;
 	}
 
-	ppelib_file_t *pe = ppelib_create();
+	return header_offset;
+}
+
+// Parses the headers and section table. buffer holds at least the headers, file_size is the size of the whole file.
+void parse_headers(ppelib_file_t *pe, const uint8_t *buffer, size_t size, size_t file_size,
+		ppelib_contents_mode_t mode) {
+	uint32_t header_offset = read_pe_header_offset(buffer, size);
 	if (ppelib_error_peek()) {
-		ppelib_destroy(pe);
-		return NULL;
+		return;
 	}
 
 	pe->pe_header_offset = header_offset;
@@ -91,129 +333,211 @@ EXPORT_SYM ppelib_file_t* ppelib_create_from_buffer(const uint8_t *buffer, size_
 
 	if (size < pe->coff_header_offset + COFF_HEADER_SIZE) {
 		ppelib_set_error("Not a PE file (file too small for COFF header)");
-		ppelib_destroy(pe);
-		return NULL;
+		return;
 	}
 
-	size_t header_size = deserialize_pe_header(buffer, pe->coff_header_offset, size, &pe->header);
+	// Reserve room for everything parsed here up front so a load normally needs a single arena chunk
+	size_t number_of_sections = read_uint16_t(buffer + pe->coff_header_offset + 2);
+	size_t arena_size = (sizeof(ppelib_section_t*) + TO_NEAREST(sizeof(ppelib_section_t), 16)) * number_of_sections;
+	arena_size += (PE_HEADER_DATA_DIRECTORIES_SIZE + sizeof(ppelib_data_directory_t)) * PE_MAX_DATA_DIRECTORIES;
+	if (mode == CONTENTS_COPY) {
+		arena_size += file_size + (16 * (number_of_sections + 2));
+	}
+	arena_reserve(&pe->arena, arena_size);
 	if (ppelib_error_peek()) {
-		ppelib_destroy(pe);
-		return NULL;
+		return;
+	}
+
+	size_t header_size = deserialize_pe_header(buffer, pe->coff_header_offset, size, &pe->header, NULL, 0, pe);
+	if (ppelib_error_peek()) {
+		return;
 	}
 
 	pe->section_offset = header_size + pe->coff_header_offset;
-	pe->sections = malloc(sizeof(ppelib_section_t*) * pe->header.number_of_sections);
+
+	pe->sections = arena_alloc(&pe->arena, sizeof(ppelib_section_t*) * pe->header.number_of_sections);
 	if (!pe->sections) {
 		ppelib_set_error("Failed to allocate sections");
-		ppelib_destroy(pe);
-		return NULL;
+		return;
 	}
 
-	pe->data_directories = calloc(sizeof(ppelib_data_directory_t) * pe->header.number_of_rva_and_sizes, 1);
+	pe->data_directories = arena_calloc(&pe->arena,
+			sizeof(ppelib_data_directory_t) * pe->header.number_of_rva_and_sizes);
 	if (!pe->data_directories) {
 		ppelib_set_error("Failed to allocate data directories");
-		ppelib_destroy(pe);
-		return NULL;
+		return;
 	}
 
 	pe->end_of_sections = 0;
 
 	for (uint32_t i = 0; i < pe->header.number_of_sections; ++i) {
-		pe->sections[i] = calloc(sizeof(ppelib_section_t), 1);
+		pe->sections[i] = arena_calloc(&pe->arena, sizeof(ppelib_section_t));
 		if (!pe->sections[i]) {
 			pe->header.number_of_sections = i;
 			ppelib_set_error("Failed to allocate section");
-			ppelib_destroy(pe);
-			return NULL;
+			return;
 		}
 	}
 	pe->allocated_sections = 1;
 
 	for (uint32_t i = 0; i < pe->header.number_of_sections; ++i) {
 		size_t section_size = deserialize_section(buffer, pe->section_offset + (i * PE_SECTION_HEADER_SIZE), size,
-				pe->sections[i]);
+				pe->sections[i], mode, &pe->arena);
 
 		if (ppelib_error_peek()) {
-			ppelib_destroy(pe);
-			return NULL;
+			return;
 		}
 
-		if (pe->sections[i]->pointer_to_raw_data > size) {
+		if (pe->sections[i]->pointer_to_raw_data > file_size) {
 			ppelib_set_error("Section past end of file");
-			ppelib_destroy(pe);
-			return NULL;
+			return;
+		}
+
+		if (mode == CONTENTS_NONE) {
+			size_t data_size = MIN(pe->sections[i]->virtual_size, pe->sections[i]->size_of_raw_data);
+			if (pe->sections[i]->pointer_to_raw_data + data_size > file_size) {
+				ppelib_set_error("Buffer too small for section size.");
+				return;
+			}
 		}
 
 		if (section_size > pe->end_of_sections) {
 			pe->end_of_sections = section_size;
 		}
+	}
 
-		for (uint32_t d = 0; d < pe->header.number_of_rva_and_sizes; ++d) {
-			size_t directory_va = pe->header.data_directories[d].virtual_address;
-			size_t directory_size = pe->header.data_directories[d].size;
-			size_t section_va = pe->sections[i]->virtual_address;
-			size_t section_va_end = section_va + pe->sections[i]->size_of_raw_data;
-
-			if (d != DIR_CERTIFICATE_TABLE) {
-				if (section_va <= directory_va && section_va_end >= directory_va) {
-					pe->data_directories[d].section = pe->sections[i];
-					pe->data_directories[d].offset = directory_va - section_va;
-					pe->data_directories[d].size = directory_size;
-					pe->data_directories[d].orig_rva = directory_va;
-					pe->data_directories[d].orig_size = directory_size;
-				}
-			}
-		}
+	build_section_index(pe);
+	if (ppelib_error_peek()) {
+		return;
 	}
 
-	if (pe->header.number_of_rva_and_sizes > DIR_CERTIFICATE_TABLE) {
-		if (pe->header.data_directories[DIR_CERTIFICATE_TABLE].size) {
-			deserialize_certificate_table(buffer, &pe->header, size, &pe->certificate_table);
-			if (ppelib_error_peek()) {
-				ppelib_destroy(pe);
-				return NULL;
-			}
+	// When only the headers are in memory long names are read through the reader
+	build_section_names(pe, size == file_size ? buffer : NULL, file_size);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	for (uint32_t d = 0; d < pe->header.number_of_rva_and_sizes; ++d) {
+		if (d == DIR_CERTIFICATE_TABLE) {
+			continue;
+		}
+
+		size_t directory_va = pe->header.data_directories[d].virtual_address;
+		size_t directory_size = pe->header.data_directories[d].size;
+
+		const ppelib_section_range_t *range = find_section_range(pe->sections_by_rva, pe->indexed_sections_by_rva,
+				directory_va);
+		if (!range) {
+			continue;
+		}
+
+		ppelib_section_t *section = pe->sections[range->index];
+		if (directory_va <= section->virtual_address + section->size_of_raw_data) {
+			pe->data_directories[d].section = section;
+			pe->data_directories[d].offset = directory_va - section->virtual_address;
+			pe->data_directories[d].size = directory_size;
+			pe->data_directories[d].orig_rva = directory_va;
+			pe->data_directories[d].orig_size = directory_size;
 		}
 	}
 
 	if (pe->header.number_of_sections) {
 		pe->start_of_sections = pe->sections[0]->virtual_address;
 	}
+}
+
+// Parses buffer into an empty handle
+void load_from_buffer(ppelib_file_t *pe, const uint8_t *buffer, size_t size, uint8_t borrow) {
+	if (borrow) {
+		pe->file_buffer = buffer;
+		pe->file_buffer_size = size;
+	}
+
+	parse_headers(pe, buffer, size, size, borrow ? CONTENTS_BORROW : CONTENTS_COPY);
+	if (ppelib_error_peek()) {
+		return;
+	}
 
 	//void* t = pe.sections[4];
 	//pe.sections[4] = pe.sections[3];
 	//pe.sections[3] = t;
 
-	pe->stub = malloc(pe->pe_header_offset);
-	if (!pe->stub) {
-		ppelib_set_error("Failed to allocate memory for PE stub");
-		ppelib_destroy(pe);
-		return NULL;
+	if (borrow) {
+		pe->stub = (uint8_t*)buffer;
+	} else {
+		pe->stub = arena_alloc(&pe->arena, pe->pe_header_offset);
+		if (!pe->stub) {
+			ppelib_set_error("Failed to allocate memory for PE stub");
+			return;
+		}
+		memcpy(pe->stub, buffer, pe->pe_header_offset);
 	}
-	memcpy(pe->stub, buffer, pe->pe_header_offset);
 
 	if (size > pe->end_of_sections) {
 		pe->trailing_data_size = size - pe->end_of_sections;
-		pe->trailing_data = malloc(pe->trailing_data_size);
 
-		if (!pe->trailing_data) {
-			ppelib_set_error("Failed to allocate memory for trailing data");
-			ppelib_destroy(pe);
-			return NULL;
-		}
+		if (borrow) {
+			pe->trailing_data = (uint8_t*)buffer + pe->end_of_sections;
+		} else {
+			pe->trailing_data = arena_alloc(&pe->arena, pe->trailing_data_size);
+			if (!pe->trailing_data) {
+				ppelib_set_error("Failed to allocate memory for trailing data");
+				return;
+			}
 
-		memcpy(pe->trailing_data, buffer + pe->end_of_sections, pe->trailing_data_size);
+			memcpy(pe->trailing_data, buffer + pe->end_of_sections, pe->trailing_data_size);
+		}
 	}
 
-	if (pe->header.number_of_rva_and_sizes > DIR_RESOURCE_TABLE) {
-		if (pe->header.data_directories[DIR_RESOURCE_TABLE].size) {
-			parse_resource_table(pe);
+	// Certificates normally live in the trailing data and are parsed from there on first access. Anything else has
+	// to be parsed while the whole buffer is still available.
+	if (pe->header.number_of_rva_and_sizes > DIR_CERTIFICATE_TABLE) {
+		if (pe->header.data_directories[DIR_CERTIFICATE_TABLE].size) {
+			if (pe->header.data_directories[DIR_CERTIFICATE_TABLE].virtual_address < pe->end_of_sections) {
+				deserialize_certificate_table(buffer, 0, size, &pe->header, &pe->certificate_table, borrow,
+						pe);
+				if (ppelib_error_peek()) {
+					return;
+				}
+				pe->certificate_table_parsed = 1;
+			}
 		}
 	}
 
+	// The copy doesn't keep the slack after section data, so verifying the checksum later needs it summed now
+	if (!borrow) {
+		pe->file_checksum = compute_buffer_checksum(buffer, size, pe->pe_header_offset);
+		pe->file_checksum_known = 1;
+	}
+
+	snapshot_image(pe);
+}
+
+ppelib_file_t* create_from_buffer(const uint8_t *buffer, size_t size, uint8_t borrow) {
+	ppelib_reset_error();
+
+	ppelib_file_t *pe = ppelib_create();
+	if (ppelib_error_peek()) {
+		return NULL;
+	}
+
+	load_from_buffer(pe, buffer, size, borrow);
+	if (ppelib_error_peek()) {
+		ppelib_destroy(pe);
+		return NULL;
+	}
+
 	return pe;
 }
 
+EXPORT_SYM ppelib_file_t* ppelib_create_from_buffer(const uint8_t *buffer, size_t size) {
+	return create_from_buffer(buffer, size, 0);
+}
+
+EXPORT_SYM ppelib_file_t* ppelib_create_from_buffer_borrowed(const uint8_t *buffer, size_t size) {
+	return create_from_buffer(buffer, size, 1);
+}
+
 EXPORT_SYM ppelib_file_t* ppelib_create_from_file(const char *filename) {
 	ppelib_reset_error();
 	size_t file_size;
@@ -226,6 +550,9 @@ EXPORT_SYM ppelib_file_t* ppelib_create_from_file(const char *filename) {
 		return NULL;
 	}
 
+	ppelib_file_identity_t source;
+	identify_file(filename, &source);
+
 	fseek(f, 0, SEEK_END);
 	file_size = ftell(f);
 	rewind(f);
@@ -236,7 +563,7 @@ EXPORT_SYM ppelib_file_t* ppelib_create_from_file(const char *filename) {
 		return NULL;
 	}
 
-	file_contents = malloc(file_size);
+	file_contents = mem_alloc(NULL, file_size);
 	if (!file_size) {
 		fclose(f);
 		ppelib_set_error("Failed to allocate file data");
@@ -253,167 +580,76 @@ EXPORT_SYM ppelib_file_t* ppelib_create_from_file(const char *filename) {
 	fclose(f);
 
 	ppelib_file_t *retval = ppelib_create_from_buffer(file_contents, file_size);
-	free(file_contents);
+	mem_free(NULL, file_contents);
+
+	if (retval) {
+		retval->source = source;
+	}
 
 	return retval;
 }
 
-EXPORT_SYM size_t ppelib_write_to_buffer(ppelib_file_t *pe, uint8_t *buffer, size_t buf_size) {
+EXPORT_SYM ppelib_file_t* ppelib_create_from_file_mapped(const char *filename) {
+#ifdef _WIN32
+	return ppelib_create_from_file(filename);
+#else
 	ppelib_reset_error();
 
-	size_t size = 0;
-
-	// Write stub
-	size += pe->pe_header_offset;
-	size += 4;
-	size_t coff_header_size = serialize_pe_header(&pe->header, NULL, pe->pe_header_offset);
-	if (ppelib_error_peek()) {
-		return 0;
-	}
-
-	size += coff_header_size;
-	size_t end_of_sections = 0;
-
-	// Write resources TODO
-//	if (pe->header.number_of_rva_and_sizes > DIR_RESOURCE_TABLE) {
-//		if (pe->data_directories[DIR_RESOURCE_TABLE].size) {
-//			ppelib_section_t *section = pe->data_directories[DIR_RESOURCE_TABLE].section;
-//			size_t offset = pe->data_directories[DIR_RESOURCE_TABLE].offset;
-//
-//			if (buffer && section) {
-//				serialize_resource_table(&pe->resource_table, section->contents + offset,
-//						pe->data_directories[DIR_RESOURCE_TABLE].orig_rva);
-//			}
-//		}
-//	}
-
-	size_t section_offset = pe->pe_header_offset + coff_header_size;
-	for (uint32_t i = 0; i < pe->header.number_of_sections; ++i) {
-		size_t section_size = serialize_section(pe->sections[i], NULL, section_offset + (i * PE_SECTION_HEADER_SIZE));
-		if (ppelib_error_peek()) {
-			return 0;
-		}
-
-		if (section_size > end_of_sections) {
-			end_of_sections = section_size;
-		}
-	}
-
-	// Theoretically all the sections could be before the header
-	if (end_of_sections > size) {
-		size = end_of_sections;
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		ppelib_set_error("Failed to open file");
+		return NULL;
 	}
 
-	size += pe->trailing_data_size;
-
-	size_t certificates_size = 0;
-	if (pe->header.number_of_rva_and_sizes > DIR_CERTIFICATE_TABLE) {
-		if (pe->header.data_directories[DIR_CERTIFICATE_TABLE].size) {
-			certificates_size = serialize_certificate_table(&pe->certificate_table, NULL);
-			if (ppelib_error_peek()) {
-				return 0;
-			}
-
-			if (certificates_size > size) {
-				size = certificates_size;
-			}
-		}
+	struct stat st;
+	if (fstat(fd, &st)) {
+		close(fd);
+		ppelib_set_error("Failed to stat file");
+		return NULL;
 	}
 
-	if (buffer && size > buf_size) {
-		ppelib_set_error("Target buffer too small.");
-		return 0;
-	}
+	ppelib_file_identity_t source;
+	identify_file(filename, &source);
 
-	if (!buffer) {
-		return size;
+	if (!st.st_size) {
+		close(fd);
+		ppelib_set_error("Empty file");
+		return NULL;
 	}
 
-	size_t write = 0;
-
-	memset(buffer, 0, size);
-	//memset(buffer, 0xCC, size);
-
-	memcpy(buffer, pe->stub, pe->pe_header_offset);
-	write += pe->pe_header_offset;
-
-	// Write PE header
-	memcpy(buffer + write, "PE\0", 4);
-	write += 4;
-
-	// Write COFF header
-	serialize_pe_header(&pe->header, buffer, pe->pe_header_offset + 4);
-	if (ppelib_error_peek()) {
-		return 0;
-	}
+	size_t file_size = st.st_size;
+	void *mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
 
-	// Write sections
-	for (uint32_t i = 0; i < pe->header.number_of_sections; ++i) {
-		serialize_section(pe->sections[i], buffer, section_offset + 4 + (i * PE_SECTION_HEADER_SIZE));
-		if (ppelib_error_peek()) {
-			return 0;
-		}
+	if (mapping == MAP_FAILED) {
+		ppelib_set_error("Failed to map file");
+		return NULL;
 	}
 
-	// Write trailing data
-	if (pe->trailing_data_size) {
-		memcpy(buffer + end_of_sections, pe->trailing_data, pe->trailing_data_size);
+	ppelib_file_t *retval = create_from_buffer(mapping, file_size, 1);
+	if (!retval) {
+		munmap(mapping, file_size);
+		return NULL;
 	}
 
-	// Write certificates
-	if (pe->header.number_of_rva_and_sizes > DIR_CERTIFICATE_TABLE) {
-		if (pe->header.data_directories[DIR_CERTIFICATE_TABLE].size) {
-			serialize_certificate_table(&pe->certificate_table, buffer);
-			if (ppelib_error_peek()) {
-				return 0;
-			}
-		}
-	}
+	retval->file_buffer_mapped = 1;
+	retval->source = source;
 
-	return size;
+	return retval;
+#endif
 }
 
-EXPORT_SYM size_t ppelib_write_to_file(ppelib_file_t *pe, const char *filename) {
+EXPORT_SYM void ppelib_recalculate(ppelib_file_t *pe) {
 	ppelib_reset_error();
 
-	FILE *f = fopen(filename, "wb");
-	if (!f) {
-		ppelib_set_error("Failed to open file");
-		return 0;
-	}
-
-	size_t bufsize = ppelib_write_to_buffer(pe, NULL, 0);
-	if (ppelib_error_peek()) {
-		fclose(f);
-		return 0;
-	}
-
-	uint8_t *buffer = malloc(bufsize);
-	if (!buffer) {
-		ppelib_set_error("Failed to allocate buffer");
-		fclose(f);
-		return 0;
-	}
-
-	ppelib_write_to_buffer(pe, buffer, bufsize);
-	if (ppelib_error_peek()) {
-		fclose(f);
-		free(buffer);
-		return 0;
-	}
-
-	size_t written = fwrite(buffer, 1, bufsize, f);
-	fclose(f);
-	free(buffer);
-
-	if (written != bufsize) {
-		ppelib_set_error("Failed to write data");
+	// The certificate directory entry is rebuilt from the table, whether or not anything has looked at it yet
+	if (ppelib_has_signature(pe)) {
+		load_once(pe, &pe->certificate_table_parsed, &pe->certificate_table_error, load_certificate_table);
+		if (ppelib_error_peek()) {
+			return;
+		}
 	}
 
-	return written;
-}
-
-EXPORT_SYM void ppelib_recalculate(ppelib_file_t *pe) {
 	size_t coff_header_size = serialize_pe_header(&pe->header, NULL, pe->pe_header_offset);
 	size_t size_of_headers = pe->pe_header_offset + 4 + coff_header_size
 			+ (pe->header.number_of_sections * PE_SECTION_HEADER_SIZE);
@@ -520,5 +756,23 @@ EXPORT_SYM void ppelib_recalculate(ppelib_file_t *pe) {
 		pe->header.data_directories[DIR_CERTIFICATE_TABLE].virtual_address = pe->certificate_table.offset;
 		pe->header.data_directories[DIR_CERTIFICATE_TABLE].size = size;
 	}
+
+	build_section_index(pe);
+}
+
+EXPORT_SYM void ppelib_recalculate_with_flags(ppelib_file_t *pe, uint32_t flags) {
+	ppelib_reset_error();
+
+	ppelib_recalculate(pe);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	if (flags & PPELIB_RECALCULATE_CHECKSUM) {
+		uint32_t checksum = compute_checksum(pe, NULL);
+		if (!ppelib_error_peek()) {
+			pe->header.checksum = checksum;
+		}
+	}
 }
 
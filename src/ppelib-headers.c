@@ -23,11 +23,12 @@
 
 #include "export.h"
 #include "main.h"
+#include "ppelib-internal.h"
 
 EXPORT_SYM ppelib_header_t* ppelib_get_header(ppelib_file_t *pe) {
 	ppelib_reset_error();
 
-	ppelib_header_t *retval = malloc(sizeof(ppelib_header_t));
+	ppelib_header_t *retval = mem_alloc(NULL, sizeof(ppelib_header_t));
 	if (!retval) {
 		ppelib_set_error("Unable to allocate header");
 		return NULL;
@@ -62,6 +63,6 @@ EXPORT_SYM void ppelib_set_header(ppelib_file_t *pe, ppelib_header_t *header) {
 }
 
 EXPORT_SYM void ppelib_free_header(ppelib_header_t *header) {
-	free(header);
+	mem_free(NULL, header);
 }
 
@@ -0,0 +1,289 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-import-table.h>
+
+#include "main.h"
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "utils.h"
+
+#define IMPORT_DESCRIPTOR_SIZE 20
+
+typedef struct import_parser {
+	ppelib_file_t *pe;
+	ppelib_import_table_t *table;
+
+	// Counted in the first pass, an upper bound as duplicates are only removed in the second
+	size_t string_bytes;
+
+	// Descriptors may share thunk arrays, so without a limit a small file could describe a quadratic number of symbols
+	size_t max_symbols;
+
+	// Hash of the interned strings, buckets hold the string offset + 1
+	size_t number_of_buckets;
+	uint32_t *buckets;
+} import_parser_t;
+
+uint32_t import_string_hash(const char *string, size_t size) {
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ (uint8_t)string[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+uint32_t intern_import_string(import_parser_t *parser, const char *string, size_t size) {
+	ppelib_import_table_t *table = parser->table;
+	size_t bucket = import_string_hash(string, size) & (parser->number_of_buckets - 1);
+
+	while (parser->buckets[bucket]) {
+		const char *interned = table->strings + parser->buckets[bucket] - 1;
+		if (memcmp(interned, string, size) == 0 && interned[size] == '\0') {
+			return parser->buckets[bucket] - 1;
+		}
+
+		bucket = (bucket + 1) & (parser->number_of_buckets - 1);
+	}
+
+	uint32_t offset = table->strings_size;
+	memcpy(table->strings + offset, string, size);
+	table->strings[offset + size] = '\0';
+	table->strings_size += size + 1;
+
+	parser->buckets[bucket] = offset + 1;
+	return offset;
+}
+
+// Counts the string in the first pass, interns it in the second
+uint32_t import_string(import_parser_t *parser, size_t rva) {
+	size_t size;
+	const char *string = rva_to_string(parser->pe, rva, &size);
+	if (ppelib_error_peek()) {
+		return 0;
+	}
+
+	if (!string) {
+		ppelib_set_error("Import name outside of section");
+		return 0;
+	}
+
+	if (!parser->table->strings) {
+		parser->string_bytes += size + 1;
+		return 0;
+	}
+
+	return intern_import_string(parser, string, size);
+}
+
+void parse_import_thunks(import_parser_t *parser, ppelib_import_descriptor_t *descriptor) {
+	ppelib_file_t *pe = parser->pe;
+	ppelib_import_table_t *table = parser->table;
+
+	uint8_t pe32plus = (pe->header.magic == PE32PLUS_MAGIC);
+	size_t thunk_size = pe32plus ? 8 : 4;
+	uint64_t ordinal_flag = pe32plus ? HIGH_BIT64 : HIGH_BIT32;
+
+	// Bound files only have the IAT, which holds the names until the loader overwrites it
+	size_t thunk_rva = descriptor->original_first_thunk ? descriptor->original_first_thunk : descriptor->first_thunk;
+
+	descriptor->first_symbol = table->number_of_symbols;
+
+	for (size_t i = 0;; ++i) {
+		size_t available;
+		const uint8_t *thunk_data = rva_to_pointer(pe, thunk_rva + (i * thunk_size), &available);
+		if (ppelib_error_peek()) {
+			return;
+		}
+
+		if (available < thunk_size) {
+			ppelib_set_error("Import thunk outside of section");
+			return;
+		}
+
+		uint64_t thunk = pe32plus ? read_uint64_t(thunk_data) : read_uint32_t(thunk_data);
+		if (!thunk) {
+			break;
+		}
+
+		ppelib_import_symbol_t symbol = { 0 };
+		symbol.iat_rva = descriptor->first_thunk ? descriptor->first_thunk + (i * thunk_size) : 0;
+
+		if (thunk & ordinal_flag) {
+			symbol.by_ordinal = 1;
+			symbol.ordinal = thunk & 0xFFFF;
+		} else {
+			size_t hint_name_rva = thunk & 0x7FFFFFFF;
+
+			const uint8_t *hint = rva_to_pointer(pe, hint_name_rva, &available);
+			if (ppelib_error_peek()) {
+				return;
+			}
+
+			if (available < 2) {
+				ppelib_set_error("Import hint outside of section");
+				return;
+			}
+
+			symbol.ordinal = read_uint16_t(hint);
+			symbol.name = import_string(parser, hint_name_rva + 2);
+			if (ppelib_error_peek()) {
+				return;
+			}
+		}
+
+		if (table->number_of_symbols >= parser->max_symbols) {
+			ppelib_set_error("Too many import symbols");
+			return;
+		}
+
+		if (table->symbols) {
+			table->symbols[table->number_of_symbols] = symbol;
+		}
+		table->number_of_symbols++;
+	}
+
+	descriptor->number_of_symbols = table->number_of_symbols - descriptor->first_symbol;
+}
+
+// The first pass only counts descriptors, symbols and string bytes, the second fills the arrays
+void walk_import_table(import_parser_t *parser) {
+	ppelib_file_t *pe = parser->pe;
+	ppelib_import_table_t *table = parser->table;
+	size_t table_rva = pe->header.data_directories[DIR_IMPORT_TABLE].virtual_address;
+
+	table->number_of_descriptors = 0;
+	table->number_of_symbols = 0;
+
+	for (size_t i = 0;; ++i) {
+		size_t available;
+		const uint8_t *data = rva_to_pointer(pe, table_rva + (i * IMPORT_DESCRIPTOR_SIZE), &available);
+		if (ppelib_error_peek()) {
+			return;
+		}
+
+		if (available < IMPORT_DESCRIPTOR_SIZE) {
+			ppelib_set_error("Import descriptor outside of section");
+			return;
+		}
+
+		ppelib_import_descriptor_t descriptor = { 0 };
+		descriptor.original_first_thunk = read_uint32_t(data + 0);
+		descriptor.time_date_stamp = read_uint32_t(data + 4);
+		descriptor.forwarder_chain = read_uint32_t(data + 8);
+		uint32_t name_rva = read_uint32_t(data + 12);
+		descriptor.first_thunk = read_uint32_t(data + 16);
+
+		if (!name_rva && !descriptor.first_thunk) {
+			break;
+		}
+
+		descriptor.name = import_string(parser, name_rva);
+		if (ppelib_error_peek()) {
+			return;
+		}
+
+		parse_import_thunks(parser, &descriptor);
+		if (ppelib_error_peek()) {
+			return;
+		}
+
+		if (table->descriptors) {
+			table->descriptors[table->number_of_descriptors] = descriptor;
+		}
+		table->number_of_descriptors++;
+	}
+}
+
+void parse_import_table(ppelib_file_t *pe) {
+	ppelib_import_table_t *table = &pe->import_table;
+	memset(table, 0, sizeof(ppelib_import_table_t));
+
+	import_parser_t parser = { 0 };
+	parser.pe = pe;
+	parser.table = table;
+
+	// Every thunk of a well formed file takes up its own bytes in some section
+	size_t section_bytes = 0;
+	for (uint16_t i = 0; i < pe->header.number_of_sections; ++i) {
+		section_bytes += MIN(pe->sections[i]->virtual_size, pe->sections[i]->size_of_raw_data);
+	}
+	size_t thunk_size = (pe->header.magic == PE32PLUS_MAGIC) ? 8 : 4;
+	parser.max_symbols = MIN(section_bytes / thunk_size, PE_MAX_IMPORT_SYMBOLS);
+
+	walk_import_table(&parser);
+	if (ppelib_error_peek()) {
+		memset(table, 0, sizeof(ppelib_import_table_t));
+		return;
+	}
+
+	size_t number_of_descriptors = table->number_of_descriptors;
+	size_t number_of_symbols = table->number_of_symbols;
+
+	if (parser.string_bytes > UINT32_MAX) {
+		ppelib_set_error("Import names too large");
+		memset(table, 0, sizeof(ppelib_import_table_t));
+		return;
+	}
+
+	parser.number_of_buckets = 8;
+	while (parser.number_of_buckets < (number_of_descriptors + number_of_symbols) * 2) {
+		parser.number_of_buckets *= 2;
+	}
+
+	parser.buckets = mem_calloc(pe, sizeof(uint32_t) * parser.number_of_buckets);
+	table->descriptors = arena_alloc(&pe->arena, sizeof(ppelib_import_descriptor_t) * number_of_descriptors);
+	table->symbols = arena_alloc(&pe->arena, sizeof(ppelib_import_symbol_t) * number_of_symbols);
+	table->strings = arena_alloc(&pe->arena, parser.string_bytes);
+	if (!parser.buckets || !table->descriptors || !table->symbols || !table->strings) {
+		ppelib_set_error("Failed to allocate import table");
+		mem_free(pe, parser.buckets);
+		memset(table, 0, sizeof(ppelib_import_table_t));
+		return;
+	}
+
+	walk_import_table(&parser);
+	mem_free(pe, parser.buckets);
+
+	if (ppelib_error_peek()) {
+		memset(table, 0, sizeof(ppelib_import_table_t));
+	}
+}
+
+void load_import_table(ppelib_file_t *pe) {
+	if (pe->header.number_of_rva_and_sizes > DIR_IMPORT_TABLE) {
+		if (pe->header.data_directories[DIR_IMPORT_TABLE].size) {
+			parse_import_table(pe);
+		}
+	}
+}
+
+EXPORT_SYM ppelib_import_table_t* ppelib_get_import_table(ppelib_file_t *pe) {
+	ppelib_reset_error();
+
+	load_once(pe, &pe->import_table_parsed, &pe->import_table_error, load_import_table);
+
+	return &pe->import_table;
+}
@@ -21,40 +21,218 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include <ppelib/ppelib-export-table.h>
+#include <ppelib/ppelib-fingerprint.h>
+#include <ppelib/ppelib-import-table.h>
+#include <ppelib/ppelib-relocation-table.h>
 #include <ppelib/ppelib-resource-table.h>
 #include <ppelib/ppelib-certificate_table.h>
+#include <ppelib/ppelib-executor.h>
 #include <ppelib/ppelib-header.h>
 #include <ppelib/ppelib-section.h>
+#include <ppelib/ppelib-sink.h>
+#include <ppelib/ppelib-stats.h>
 
 #include "main.h"
 
+typedef enum ppelib_contents_mode {
+	CONTENTS_COPY = 0,
+	CONTENTS_BORROW,
+	CONTENTS_NONE,
+} ppelib_contents_mode_t;
+
+#define HASH_BLOCK_SIZE 64
+
+typedef struct hash_context {
+	uint32_t algorithm;
+	uint64_t length;
+	uint32_t state[8];
+
+	size_t buffered;
+	uint8_t buffer[HASH_BLOCK_SIZE];
+} hash_context_t;
+
+// The output image is described as a list of extents. Where extents overlap the one added last wins, which matches
+// the order in which the original buffer writer used to copy them.
+typedef struct image_extent {
+	size_t offset;
+	size_t size;
+	size_t priority;
+
+	// When data is NULL the extent is read from the reader at source
+	const uint8_t *data;
+	size_t source;
+} image_extent_t;
+
+typedef struct image_layout {
+	size_t size;
+	size_t end_of_sections;
+	size_t section_offset;
+
+	// Read once, another thread may parse the certificate table while the image is written
+	uint8_t certificates_parsed;
+
+	size_t number_of_extents;
+	image_extent_t *extents;
+
+	uint8_t *headers;
+	uint8_t *certificate_headers;
+} image_layout_t;
+
+void serialize_certificate_header(const ppelib_certificate_t *certificate, uint8_t *buffer);
 size_t serialize_certificate_table(const ppelib_certificate_table_t *certificate_table, uint8_t *buffer);
-size_t deserialize_certificate_table(const uint8_t *buffer, ppelib_header_t *header, const size_t size,
-		ppelib_certificate_table_t *certificate_table);
+size_t deserialize_certificate_table(const uint8_t *buffer, size_t base, const size_t size, ppelib_header_t *header,
+		ppelib_certificate_table_t *certificate_table, uint8_t borrow, const ppelib_file_t *pe);
 
 size_t serialize_pe_header(const ppelib_header_t *header, uint8_t *buffer, size_t offset);
-size_t deserialize_pe_header(const uint8_t *buffer, size_t offset, const size_t size, ppelib_header_t *header);
+size_t deserialize_pe_header(const uint8_t *buffer, size_t offset, const size_t size, ppelib_header_t *header,
+		ppelib_header_data_directory_t *directories_storage, size_t max_directories, ppelib_file_t *pe);
 
+void serialize_section_header(const ppelib_section_t *section, uint8_t *section_header);
 size_t serialize_section(const ppelib_section_t *section, uint8_t *buffer, size_t offset);
-size_t deserialize_section(const uint8_t *buffer, size_t offset, const size_t size, ppelib_section_t *section);
+size_t deserialize_section(const uint8_t *buffer, size_t offset, const size_t size, ppelib_section_t *section,
+		ppelib_contents_mode_t mode, ppelib_arena_t *arena);
+
+uint32_t read_pe_header_offset(const uint8_t *buffer, size_t size);
+void parse_headers(ppelib_file_t *pe, const uint8_t *buffer, size_t size, size_t file_size,
+		ppelib_contents_mode_t mode);
 
 void ppelib_section_excise(ppelib_file_t *pe, uint16_t section_index, size_t start, size_t end);
 void ppelib_section_resize(ppelib_file_t *pe, uint16_t section_index, size_t size);
 
-void ppelib_free_certificate_table(ppelib_certificate_table_t *certificate_table);
+void ppelib_free_certificate_table(const ppelib_file_t *pe, ppelib_certificate_table_t *certificate_table);
+void ppelib_section_write(ppelib_file_t *pe, uint16_t section_index, size_t offset, const uint8_t *data,
+		size_t size);
+void build_section_index(ppelib_file_t *pe);
+const uint8_t* rva_to_pointer(ppelib_file_t *pe, size_t rva, size_t *available);
+const char* rva_to_string(ppelib_file_t *pe, size_t rva, size_t *size);
+ppelib_section_t* section_for_rva(const ppelib_file_t *pe, size_t rva);
+const ppelib_section_range_t* find_section_range(const ppelib_section_range_t *ranges, size_t number_of_ranges,
+		size_t value);
+void build_section_names(ppelib_file_t *pe, const uint8_t *buffer, size_t size);
 uint16_t ppelib_section_find_index(ppelib_file_t *pe, ppelib_section_t *section);
 
-size_t parse_resource_table(ppelib_file_t *pe);
+size_t parse_resource_table(ppelib_file_t *pe, const ppelib_executor_t *executor);
 size_t serialize_resource_table(const ppelib_resource_table_t *resource_table, uint8_t *buffer, size_t rscs_base);
 
+void parse_export_table(ppelib_file_t *pe);
+void parse_import_table(ppelib_file_t *pe);
+void parse_relocation_table(ppelib_file_t *pe);
+void decode_fixups(ppelib_file_t *pe);
+
 void free_resource_directory(ppelib_file_t *pe);
+void build_resource_index(ppelib_file_t *pe);
+uint8_t load_resource_index(ppelib_file_t *pe);
+
+void reader_read(ppelib_file_t *pe, size_t offset, uint8_t *buffer, size_t size);
+void reader_load_certificate_table(ppelib_file_t *pe);
+void load_certificate_table(ppelib_file_t *pe);
+void free_block_cache(ppelib_file_t *pe);
+uint8_t* load_section_contents(ppelib_file_t *pe, ppelib_section_t *section);
+uint8_t* load_trailing_data(ppelib_file_t *pe);
+
+size_t image_size(ppelib_file_t *pe, image_layout_t *layout);
+size_t image_headers_size(const ppelib_file_t *pe, size_t section_offset);
+void write_image_headers(ppelib_file_t *pe, size_t section_offset, uint8_t *headers);
+uint8_t* serialize_image_headers(ppelib_file_t *pe, size_t section_offset, size_t *size);
+
+void load_from_buffer(ppelib_file_t *pe, const uint8_t *buffer, size_t size, uint8_t borrow);
+
+size_t write_image_bounded(ppelib_file_t *pe, const ppelib_sink_t *sink, size_t max_size);
+size_t write_image(ppelib_file_t *pe, const ppelib_sink_t *sink);
+#ifndef _WIN32
+size_t write_image_to_fd(ppelib_file_t *pe, int fd);
+#endif
+size_t write_file(ppelib_file_t *pe, const char *filename);
+uint8_t stream_original_file(ppelib_file_t *pe, const ppelib_sink_t *sink, const ppelib_executor_t *executor);
+
+void snapshot_image(ppelib_file_t *pe);
+uint8_t identify_file(const char *filename, ppelib_file_identity_t *identity);
+void mark_dirty(ppelib_file_t *pe, size_t offset, size_t size);
+size_t write_replacement(ppelib_file_t *pe, const char *filename);
+
+uint64_t checksum_add(uint64_t sum, const uint8_t *data, size_t size, size_t offset);
+uint32_t checksum_finish(uint64_t sum, size_t size);
+size_t checksum_field_offset(size_t pe_header_offset);
+uint32_t compute_buffer_checksum(const uint8_t *buffer, size_t size, size_t pe_header_offset);
+uint32_t compute_checksum(ppelib_file_t *pe, const ppelib_executor_t *executor);
+
+void invalidate_stats(ppelib_stats_cache_t *cache);
+
+size_t hash_digest_size(uint32_t algorithm);
+void hash_init(hash_context_t *context, uint32_t algorithm);
+void hash_update(hash_context_t *context, const uint8_t *data, size_t size);
+void hash_final(hash_context_t *context, uint8_t *digest);
+
+char ascii_lowercase(char c);
+const char* ordinal_name(const char *library, uint16_t ordinal);
+
+size_t executor_concurrency(const ppelib_executor_t *executor);
+void executor_run(const ppelib_executor_t *executor, void (*task)(void *argument, size_t index), void *argument,
+		size_t count);
+
+uint8_t init_lock(ppelib_lock_t *lock);
+void destroy_lock(ppelib_lock_t *lock);
+void acquire_lock(ppelib_lock_t *lock);
+void release_lock(ppelib_lock_t *lock);
+void lock_file(ppelib_file_t *pe);
+void unlock_file(ppelib_file_t *pe);
+const char* keep_load_error(ppelib_file_t *pe);
+void load_once(ppelib_file_t *pe, atomic_uchar *loaded, const char **error, void (*load)(ppelib_file_t *pe));
+
+const ppelib_allocator_t* get_allocator(const ppelib_file_t *pe);
+void* mem_alloc(const ppelib_file_t *pe, size_t size);
+void* mem_calloc(const ppelib_file_t *pe, size_t size);
+void* mem_realloc(const ppelib_file_t *pe, void *ptr, size_t size);
+void mem_free(const ppelib_file_t *pe, void *ptr);
+
+void arena_reserve(ppelib_arena_t *arena, size_t size);
+void* arena_alloc(ppelib_arena_t *arena, size_t size);
+void* arena_calloc(ppelib_arena_t *arena, size_t size);
+uint8_t arena_owns(const ppelib_arena_t *arena, const void *ptr);
+void arena_merge(ppelib_arena_t *arena, ppelib_arena_t *other);
+void arena_reset(ppelib_arena_t *arena);
+void arena_destroy(ppelib_arena_t *arena);
+
+uint8_t buffer_is_borrowed(const ppelib_file_t *pe, const void *ptr);
+void buffer_free(const ppelib_file_t *pe, void *ptr);
+uint8_t* buffer_make_owned(const ppelib_file_t *pe, uint8_t **ptr, size_t size);
+uint16_t buffer_excise(const ppelib_file_t *pe, uint8_t **buffer, size_t size, size_t start, size_t end);
+
+// Copies of <ppelib/ppelib.h>
+
+ppelib_file_t* ppelib_create();
+ppelib_file_t* ppelib_create_with_allocator(const ppelib_allocator_t *allocator);
+void ppelib_reset(ppelib_file_t *pe);
+void ppelib_destroy(ppelib_file_t *pe);
+uint32_t ppelib_has_signature(ppelib_file_t *pe);
 
 // Copies of <ppelib/ppelib-low-level.h>
 
 void ppelib_recalculate(ppelib_file_t *pe);
+void ppelib_recalculate_with_flags(ppelib_file_t *pe, uint32_t flags);
 
 ppelib_header_t* ppelib_get_header(ppelib_file_t *pe);
 void ppelib_free_header(ppelib_header_t *header);
 void ppelib_set_header(ppelib_file_t *pe, ppelib_header_t *header);
 
+const char* ppelib_section_get_name(ppelib_file_t *pe, uint16_t section_index);
+ppelib_section_t* ppelib_section_find_by_name(ppelib_file_t *pe, const char *name);
+
+ppelib_section_t* ppelib_rva_to_section(ppelib_file_t *pe, size_t rva);
+size_t ppelib_rva_to_offset(ppelib_file_t *pe, size_t rva);
+size_t ppelib_offset_to_rva(ppelib_file_t *pe, size_t offset);
+
+ppelib_certificate_table_t* ppelib_get_certificate_table(ppelib_file_t *pe);
+ppelib_export_table_t* ppelib_get_export_table(ppelib_file_t *pe);
+ppelib_export_t ppelib_export_find_by_name(ppelib_file_t *pe, const char *name);
+ppelib_export_t ppelib_export_find_by_ordinal(ppelib_file_t *pe, uint32_t ordinal);
+ppelib_import_table_t* ppelib_get_import_table(ppelib_file_t *pe);
+ppelib_relocation_table_t* ppelib_get_relocation_table(ppelib_file_t *pe);
+void ppelib_rebase(ppelib_file_t *pe, uint64_t image_base);
+ppelib_resource_table_t* ppelib_get_resource_table(ppelib_file_t *pe);
+ppelib_resource_data_t* ppelib_resource_find(ppelib_file_t *pe, ppelib_resource_id_t type, ppelib_resource_id_t name,
+		uint32_t language);
+const ppelib_resource_entry_t* ppelib_resource_find_type(ppelib_file_t *pe, ppelib_resource_id_t type, size_t *count);
+
 #endif /* PPELIB_INTERNAL_H_ */
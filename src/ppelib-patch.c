@@ -0,0 +1,431 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _WIN32
+#define _XOPEN_SOURCE 700
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <ppelib/ppelib-constants.h>
+
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "main.h"
+
+// Differences in the headers closer together than this are written as one range
+#define PATCH_MERGE_DISTANCE 8
+
+#ifndef _WIN32
+typedef int patch_file_t;
+#else
+typedef FILE *patch_file_t;
+#endif
+
+void snapshot_image(ppelib_file_t *pe) {
+	pe->original_headers_size = 0;
+	pe->number_of_dirty_ranges = 0;
+
+	image_layout_t layout;
+	pe->original_size = image_size(pe, &layout);
+	if (ppelib_error_peek()) {
+		goto end;
+	}
+
+	size_t headers_size = image_headers_size(pe, layout.section_offset);
+	if (headers_size > pe->allocated_original_headers) {
+		uint8_t *headers = mem_realloc(pe, pe->original_headers, headers_size);
+		if (!headers) {
+			goto end;
+		}
+
+		pe->original_headers = headers;
+		pe->allocated_original_headers = headers_size;
+	}
+
+	write_image_headers(pe, layout.section_offset, pe->original_headers);
+	if (!ppelib_error_peek()) {
+		pe->original_headers_size = headers_size;
+		pe->original_pe_header_offset = pe->pe_header_offset;
+	}
+
+	// Without a snapshot the next patch just becomes a full rewrite
+	end:
+	if (ppelib_error_peek()) {
+		ppelib_reset_error();
+	}
+}
+
+// Follows symlinks, so the identity is that of the file that would be written to
+uint8_t identify_file(const char *filename, ppelib_file_identity_t *identity) {
+	memset(identity, 0, sizeof(ppelib_file_identity_t));
+
+#ifndef _WIN32
+	struct stat st;
+	if (stat(filename, &st)) {
+		return 0;
+	}
+#else
+	struct _stat64 st;
+	if (_stat64(filename, &st)) {
+		return 0;
+	}
+#endif
+
+	identity->known = 1;
+	identity->device = st.st_dev;
+	identity->inode = st.st_ino;
+	identity->modified = st.st_mtime;
+
+	return 1;
+}
+
+void mark_dirty(ppelib_file_t *pe, size_t offset, size_t size) {
+	if (!size) {
+		return;
+	}
+
+	if (pe->number_of_dirty_ranges == pe->allocated_dirty_ranges) {
+		size_t allocated = pe->allocated_dirty_ranges ? pe->allocated_dirty_ranges * 2 : 8;
+		ppelib_range_t *ranges = mem_realloc(pe, pe->dirty_ranges, sizeof(ppelib_range_t) * allocated);
+		if (!ranges) {
+			ppelib_set_error("Failed to allocate dirty ranges");
+			return;
+		}
+
+		pe->dirty_ranges = ranges;
+		pe->allocated_dirty_ranges = allocated;
+	}
+
+	pe->dirty_ranges[pe->number_of_dirty_ranges].offset = offset;
+	pe->dirty_ranges[pe->number_of_dirty_ranges].size = size;
+	pe->number_of_dirty_ranges++;
+}
+
+int compare_ranges(const void *a, const void *b) {
+	const ppelib_range_t *ra = a;
+	const ppelib_range_t *rb = b;
+
+	if (ra->offset == rb->offset) {
+		return 0;
+	}
+
+	return ra->offset < rb->offset ? -1 : 1;
+}
+
+void merge_dirty_ranges(ppelib_file_t *pe) {
+	if (!pe->number_of_dirty_ranges) {
+		return;
+	}
+
+	qsort(pe->dirty_ranges, pe->number_of_dirty_ranges, sizeof(ppelib_range_t), compare_ranges);
+
+	size_t merged = 0;
+	for (size_t i = 1; i < pe->number_of_dirty_ranges; ++i) {
+		ppelib_range_t *last = &pe->dirty_ranges[merged];
+		ppelib_range_t *range = &pe->dirty_ranges[i];
+
+		if (range->offset <= last->offset + last->size) {
+			size_t end = MAX(last->offset + last->size, range->offset + range->size);
+			last->size = end - last->offset;
+		} else {
+			pe->dirty_ranges[++merged] = *range;
+		}
+	}
+
+	pe->number_of_dirty_ranges = merged + 1;
+}
+
+// The layout is unchanged when every byte that is not in the headers or a dirty range is still where it was
+uint8_t layout_unchanged(ppelib_file_t *pe, const image_layout_t *layout, size_t headers_size) {
+	if (!pe->original_headers_size) {
+		return 0;
+	}
+
+	if (layout->size != pe->original_size || headers_size != pe->original_headers_size
+			|| pe->pe_header_offset != pe->original_pe_header_offset) {
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < pe->header.number_of_sections; ++i) {
+		size_t header_offset = layout->section_offset + 4 + (i * PE_SECTION_HEADER_SIZE) - pe->pe_header_offset;
+		ppelib_section_t original;
+
+		deserialize_section(pe->original_headers, header_offset, pe->original_headers_size, &original, CONTENTS_NONE,
+				NULL);
+		if (ppelib_error_peek()) {
+			return 0;
+		}
+
+		const ppelib_section_t *section = pe->sections[i];
+		if (section->pointer_to_raw_data != original.pointer_to_raw_data
+				|| section->size_of_raw_data != original.size_of_raw_data
+				|| section->virtual_size != original.virtual_size) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+size_t patch_write(patch_file_t f, size_t offset, const uint8_t *data, size_t size) {
+#ifndef _WIN32
+	size_t written = 0;
+	while (written < size) {
+		ssize_t retsize = pwrite(f, data + written, size - written, offset + written);
+		if (retsize <= 0) {
+			break;
+		}
+		written += retsize;
+	}
+#else
+	if (fseek(f, offset, SEEK_SET)) {
+		return 0;
+	}
+	size_t written = fwrite(data, 1, size, f);
+#endif
+
+	if (written != size) {
+		ppelib_set_error("Failed to write data");
+	}
+
+	return written;
+}
+
+// Returns 0 when the file on disk isn't the one that was loaded, as far as can be told without reading it
+uint8_t write_patch(ppelib_file_t *pe, const char *filename, const uint8_t *headers, size_t headers_size,
+		size_t *written) {
+	// Any other file gets the whole image, even one of the same size
+	ppelib_file_identity_t target;
+	if (!pe->source.known || !identify_file(filename, &target) || target.device != pe->source.device
+			|| target.inode != pe->source.inode || target.modified != pe->source.modified) {
+		return 0;
+	}
+
+#ifndef _WIN32
+	patch_file_t f = open(filename, O_WRONLY);
+	if (f < 0) {
+		return 0;
+	}
+
+	struct stat st;
+	if (fstat(f, &st) || (size_t)st.st_size != pe->original_size) {
+		close(f);
+		return 0;
+	}
+#else
+	patch_file_t f = fopen(filename, "r+b");
+	if (!f) {
+		return 0;
+	}
+#endif
+
+	size_t i = 0;
+	*written = 0;
+
+	while (i < headers_size && !ppelib_error_peek()) {
+		if (headers[i] == pe->original_headers[i]) {
+			++i;
+			continue;
+		}
+
+		size_t start = i;
+		size_t end = i + 1;
+		for (size_t j = end; j < headers_size && j < end + PATCH_MERGE_DISTANCE; ++j) {
+			if (headers[j] != pe->original_headers[j]) {
+				end = j + 1;
+			}
+		}
+
+		*written += patch_write(f, pe->pe_header_offset + start, headers + start, end - start);
+		i = end;
+	}
+
+	merge_dirty_ranges(pe);
+
+	for (size_t r = 0; r < pe->number_of_dirty_ranges && !ppelib_error_peek(); ++r) {
+		const ppelib_range_t *range = &pe->dirty_ranges[r];
+
+		for (uint32_t s = 0; s < pe->header.number_of_sections; ++s) {
+			ppelib_section_t *section = pe->sections[s];
+			size_t data_size = MIN(section->virtual_size, section->size_of_raw_data);
+			size_t section_start = section->pointer_to_raw_data;
+			size_t section_end = section_start + data_size;
+
+			size_t start = MAX(range->offset, section_start);
+			size_t end = MIN(range->offset + range->size, section_end);
+			if (start >= end || !section->contents) {
+				continue;
+			}
+
+			*written += patch_write(f, start, section->contents + (start - section_start), end - start);
+			if (ppelib_error_peek()) {
+				break;
+			}
+		}
+	}
+
+#ifndef _WIN32
+	if (close(f) && !ppelib_error_peek()) {
+		ppelib_set_error("Failed to write data");
+	}
+#else
+	fclose(f);
+#endif
+
+	return 1;
+}
+
+// Writes the whole image to a new file next to the target and moves it in place, the handle may still be reading from
+// the original file. A symlink is followed and the file it points to is replaced, keeping its mode and owner.
+size_t write_replacement(ppelib_file_t *pe, const char *filename) {
+#ifndef _WIN32
+	char *target = realpath(filename, NULL);
+	if (!target) {
+		// Nothing there to replace or keep
+		return write_file(pe, filename);
+	}
+
+	struct stat original;
+	size_t target_size = strlen(target);
+	char *temp_filename = mem_alloc(pe, target_size + sizeof(".XXXXXX"));
+	if (!temp_filename || stat(target, &original)) {
+		ppelib_set_error(temp_filename ? "Failed to open file" : "Failed to allocate filename");
+		mem_free(pe, temp_filename);
+		free(target);
+		return 0;
+	}
+
+	memcpy(temp_filename, target, target_size);
+	memcpy(temp_filename + target_size, ".XXXXXX", sizeof(".XXXXXX"));
+
+	// Always a new file, whatever already exists at a name is never written through
+	int fd = mkstemp(temp_filename);
+	if (fd < 0) {
+		ppelib_set_error("Failed to create temporary file");
+		mem_free(pe, temp_filename);
+		free(target);
+		return 0;
+	}
+
+	size_t written = 0;
+	if (fchmod(fd, original.st_mode & 07777)) {
+		ppelib_set_error("Failed to set file mode");
+		close(fd);
+	} else {
+		if (fchown(fd, original.st_uid, original.st_gid) && fchown(fd, (uid_t)-1, original.st_gid)) {
+			// Only root can give a file away, anyone else owns the new file like any other they write. Not an error.
+		}
+
+		written = write_image_to_fd(pe, fd);
+	}
+
+	if (ppelib_error_peek()) {
+		unlink(temp_filename);
+		written = 0;
+	} else if (rename(temp_filename, target)) {
+		ppelib_set_error("Failed to replace file");
+		unlink(temp_filename);
+		written = 0;
+	}
+
+	mem_free(pe, temp_filename);
+	free(target);
+	return written;
+#else
+	return write_file(pe, filename);
+#endif
+}
+
+EXPORT_SYM size_t ppelib_write_patch_to_file(ppelib_file_t *pe, const char *filename) {
+	ppelib_reset_error();
+
+	image_layout_t layout;
+	image_size(pe, &layout);
+	if (ppelib_error_peek()) {
+		return 0;
+	}
+
+	size_t headers_size = 0;
+	uint8_t *headers = serialize_image_headers(pe, layout.section_offset, &headers_size);
+	if (ppelib_error_peek()) {
+		return 0;
+	}
+
+	size_t written = 0;
+	uint8_t patched = 0;
+
+	if (layout_unchanged(pe, &layout, headers_size)) {
+		patched = write_patch(pe, filename, headers, headers_size, &written);
+	}
+
+	if (!patched && !ppelib_error_peek()) {
+		written = write_replacement(pe, filename);
+	}
+
+	mem_free(pe, headers);
+	if (ppelib_error_peek()) {
+		return 0;
+	}
+
+	snapshot_image(pe);
+	identify_file(filename, &pe->source);
+
+	return written;
+}
+
+EXPORT_SYM void ppelib_section_write(ppelib_file_t *pe, uint16_t section_index, size_t offset, const uint8_t *data,
+		size_t size) {
+	ppelib_reset_error();
+
+	if (section_index >= pe->header.number_of_sections) {
+		ppelib_set_error("Section index out of range");
+		return;
+	}
+
+	ppelib_section_t *section = pe->sections[section_index];
+	size_t data_size = MIN(section->virtual_size, section->size_of_raw_data);
+
+	if (offset > data_size || size > data_size - offset) {
+		ppelib_set_error("Can't write past section end");
+		return;
+	}
+
+	load_section_contents(pe, section);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	if (!buffer_make_owned(pe, &section->contents, data_size)) {
+		return;
+	}
+
+	memcpy(section->contents + offset, data, size);
+	mark_dirty(pe, section->pointer_to_raw_data + offset, size);
+	invalidate_stats(&pe->section_stats);
+}
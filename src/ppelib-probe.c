@@ -0,0 +1,152 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-probe.h>
+
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+
+// Everything in here works on caller-provided storage only; nothing may allocate.
+void probe_buffer(const uint8_t *buffer, size_t size, size_t file_size, ppelib_probe_t *probe) {
+	memset(probe, 0, sizeof(ppelib_probe_t));
+
+	uint32_t header_offset = read_pe_header_offset(buffer, size);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	probe->pe_header_offset = header_offset;
+	probe->coff_header_offset = header_offset + 4;
+
+	if (size < probe->coff_header_offset + COFF_HEADER_SIZE) {
+		ppelib_set_error("Not a PE file (file too small for COFF header)");
+		return;
+	}
+
+	size_t header_size = deserialize_pe_header(buffer, probe->coff_header_offset, size, &probe->header,
+			probe->data_directories, PE_MAX_DATA_DIRECTORIES, NULL);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	if (probe->header.number_of_sections > PE_MAX_SECTIONS) {
+		ppelib_set_error("Too many sections for probe");
+		return;
+	}
+
+	probe->section_offset = header_size + probe->coff_header_offset;
+
+	for (uint32_t i = 0; i < probe->header.number_of_sections; ++i) {
+		size_t offset = probe->section_offset + (i * PE_SECTION_HEADER_SIZE);
+		if (offset + PE_SECTION_HEADER_SIZE > size) {
+			ppelib_set_error("Buffer too small for section header.");
+			return;
+		}
+
+		deserialize_section(buffer, offset, size, &probe->sections[i], CONTENTS_NONE, NULL);
+		if (ppelib_error_peek()) {
+			return;
+		}
+
+		if (file_size && probe->sections[i].pointer_to_raw_data > file_size) {
+			ppelib_set_error("Section past end of file");
+			return;
+		}
+	}
+}
+
+EXPORT_SYM void ppelib_probe(const uint8_t *buffer, size_t size, ppelib_probe_t *probe) {
+	ppelib_reset_error();
+
+	probe_buffer(buffer, size, 0, probe);
+}
+
+EXPORT_SYM void ppelib_probe_file(const char *filename, ppelib_probe_t *probe) {
+	ppelib_reset_error();
+
+	uint8_t buffer[PPELIB_PROBE_SIZE];
+	size_t size = 0;
+	size_t file_size = 0;
+
+#ifdef _WIN32
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		ppelib_set_error("Failed to open file");
+		return;
+	}
+
+	fseek(f, 0, SEEK_END);
+	file_size = ftell(f);
+	rewind(f);
+
+	size = fread(buffer, 1, PPELIB_PROBE_SIZE, f);
+	fclose(f);
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		ppelib_set_error("Failed to open file");
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st)) {
+		close(fd);
+		ppelib_set_error("Failed to stat file");
+		return;
+	}
+	file_size = st.st_size;
+
+	while (size < PPELIB_PROBE_SIZE) {
+		ssize_t retsize = read(fd, buffer + size, PPELIB_PROBE_SIZE - size);
+		if (retsize < 0) {
+			close(fd);
+			ppelib_set_error("Failed to read file data");
+			return;
+		}
+
+		if (!retsize) {
+			break;
+		}
+
+		size += retsize;
+	}
+	close(fd);
+#endif
+
+	if (!size) {
+		ppelib_set_error("Empty file");
+		return;
+	}
+
+	probe_buffer(buffer, size, file_size, probe);
+}
@@ -0,0 +1,425 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-reader.h>
+
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "main.h"
+
+#define READER_STREAM_SIZE (1024 * 1024)
+
+// Returns 0 when the reader fails. Doesn't set an error, so it can run on any thread.
+uint8_t read_fully(const ppelib_file_t *pe, size_t offset, uint8_t *buffer, size_t size) {
+	while (size) {
+		size_t retsize = pe->reader.read_at(pe->reader.context, offset, buffer, size);
+		if (!retsize || retsize > size) {
+			return 0;
+		}
+
+		offset += retsize;
+		buffer += retsize;
+		size -= retsize;
+	}
+
+	return 1;
+}
+
+void read_direct(ppelib_file_t *pe, size_t offset, uint8_t *buffer, size_t size) {
+	if (!read_fully(pe, offset, buffer, size)) {
+		ppelib_set_error("Failed to read file data");
+	}
+}
+
+void read_cached(ppelib_file_t *pe, size_t offset, uint8_t *buffer, size_t size) {
+	if (offset > pe->reader.size || size > pe->reader.size - offset) {
+		ppelib_set_error("Read past end of file");
+		return;
+	}
+
+	ppelib_block_cache_t *cache = &pe->block_cache;
+	if (!cache->number_of_blocks || size >= PPELIB_READER_BLOCK_SIZE) {
+		read_direct(pe, offset, buffer, size);
+		return;
+	}
+
+	while (size) {
+		size_t block = offset / PPELIB_READER_BLOCK_SIZE;
+		size_t block_offset = offset % PPELIB_READER_BLOCK_SIZE;
+		size_t slot = block % cache->number_of_blocks;
+		uint8_t *data = cache->data + (slot * PPELIB_READER_BLOCK_SIZE);
+
+		// Tags are stored off by one so an empty slot is 0
+		if (cache->tags[slot] != block + 1) {
+			size_t block_start = block * PPELIB_READER_BLOCK_SIZE;
+			size_t block_size = MIN(PPELIB_READER_BLOCK_SIZE, pe->reader.size - block_start);
+
+			cache->tags[slot] = 0;
+			read_direct(pe, block_start, data, block_size);
+			if (ppelib_error_peek()) {
+				return;
+			}
+			cache->tags[slot] = block + 1;
+		}
+
+		size_t chunk = MIN(size, PPELIB_READER_BLOCK_SIZE - block_offset);
+		memcpy(buffer, data + block_offset, chunk);
+
+		offset += chunk;
+		buffer += chunk;
+		size -= chunk;
+	}
+}
+
+// The block cache is shared by every thread reading the handle, and read_at is never called concurrently
+void reader_read(ppelib_file_t *pe, size_t offset, uint8_t *buffer, size_t size) {
+	lock_file(pe);
+	read_cached(pe, offset, buffer, size);
+	unlock_file(pe);
+}
+
+void free_block_cache(ppelib_file_t *pe) {
+	mem_free(pe, pe->block_cache.tags);
+	mem_free(pe, pe->block_cache.data);
+	memset(&pe->block_cache, 0, sizeof(ppelib_block_cache_t));
+}
+
+// Only reader handles load anything lazily, they do so under the handle lock
+uint8_t* load_section_contents(ppelib_file_t *pe, ppelib_section_t *section) {
+	size_t data_size = MIN(section->virtual_size, section->size_of_raw_data);
+	if (!data_size || !pe->reader.read_at) {
+		return section->contents;
+	}
+
+	lock_file(pe);
+
+	if (!section->contents) {
+		uint8_t *contents = arena_alloc(&pe->arena, data_size);
+		if (!contents) {
+			ppelib_set_error("Failed to allocate section contents");
+		} else {
+			read_cached(pe, section->pointer_to_raw_data, contents, data_size);
+			if (!ppelib_error_peek()) {
+				section->contents = contents;
+			}
+		}
+	}
+
+	uint8_t *contents = section->contents;
+	unlock_file(pe);
+
+	return contents;
+}
+
+uint8_t* load_trailing_data(ppelib_file_t *pe) {
+	if (!pe->trailing_data_size || !pe->reader.read_at) {
+		return pe->trailing_data;
+	}
+
+	lock_file(pe);
+
+	if (!pe->trailing_data) {
+		uint8_t *trailing_data = arena_alloc(&pe->arena, pe->trailing_data_size);
+		if (!trailing_data) {
+			ppelib_set_error("Failed to allocate memory for trailing data");
+		} else {
+			read_cached(pe, pe->end_of_sections, trailing_data, pe->trailing_data_size);
+			if (!ppelib_error_peek()) {
+				pe->trailing_data = trailing_data;
+			}
+		}
+	}
+
+	uint8_t *trailing_data = pe->trailing_data;
+	unlock_file(pe);
+
+	return trailing_data;
+}
+
+// Reads just the certificate table instead of all of the trailing data
+void reader_load_certificate_table(ppelib_file_t *pe) {
+	size_t table_offset = pe->header.data_directories[DIR_CERTIFICATE_TABLE].virtual_address;
+	size_t table_size = pe->header.data_directories[DIR_CERTIFICATE_TABLE].size;
+
+	if (table_offset > pe->reader.size || table_size > pe->reader.size - table_offset) {
+		ppelib_set_error("Buffer too small for table.");
+		return;
+	}
+
+	uint8_t *buffer = mem_alloc(pe, table_size);
+	if (!buffer) {
+		ppelib_set_error("Failed to allocate certificate table");
+		return;
+	}
+
+	reader_read(pe, table_offset, buffer, table_size);
+	if (!ppelib_error_peek()) {
+		deserialize_certificate_table(buffer, table_offset, table_size, &pe->header, &pe->certificate_table, 0, pe);
+	}
+
+	mem_free(pe, buffer);
+}
+
+void stream_reader(ppelib_file_t *pe, const ppelib_sink_t *sink, uint8_t *buffer) {
+	for (size_t offset = 0; offset < pe->reader.size; offset += READER_STREAM_SIZE) {
+		size_t size = MIN(READER_STREAM_SIZE, pe->reader.size - offset);
+
+		read_direct(pe, offset, buffer, size);
+		if (ppelib_error_peek()) {
+			return;
+		}
+
+		if (sink->write(sink->context, offset, buffer, size) != size) {
+			ppelib_set_error("Failed to write data");
+			return;
+		}
+	}
+}
+
+typedef struct stream_pipeline {
+	ppelib_file_t *pe;
+	const ppelib_sink_t *sink;
+
+	uint8_t *buffers[2];
+	size_t offset;
+
+	uint8_t read_failed;
+	uint8_t write_failed;
+} stream_pipeline_t;
+
+// Task 0 writes the chunk at offset to the sink while task 1 reads the next one into the other buffer
+void stream_pipeline_task(void *argument, size_t index) {
+	stream_pipeline_t *pipeline = argument;
+	ppelib_file_t *pe = pipeline->pe;
+	size_t chunk = pipeline->offset / READER_STREAM_SIZE;
+
+	if (index == 0) {
+		size_t size = MIN(READER_STREAM_SIZE, pe->reader.size - pipeline->offset);
+		const uint8_t *buffer = pipeline->buffers[chunk % 2];
+
+		if (pipeline->sink->write(pipeline->sink->context, pipeline->offset, buffer, size) != size) {
+			pipeline->write_failed = 1;
+		}
+	} else {
+		size_t offset = pipeline->offset + READER_STREAM_SIZE;
+		size_t size = MIN(READER_STREAM_SIZE, pe->reader.size - offset);
+
+		if (!read_fully(pe, offset, pipeline->buffers[(chunk + 1) % 2], size)) {
+			pipeline->read_failed = 1;
+		}
+	}
+}
+
+// Reads the next chunk from the reader while the sink is busy with the current one. The handle lock is held by the
+// calling thread throughout, so read_at is still only called by one thread at a time.
+void stream_reader_pipelined(ppelib_file_t *pe, const ppelib_sink_t *sink, const ppelib_executor_t *executor,
+		uint8_t *buffer) {
+	stream_pipeline_t pipeline = { 0 };
+	pipeline.pe = pe;
+	pipeline.sink = sink;
+	pipeline.buffers[0] = buffer;
+	pipeline.buffers[1] = mem_alloc(pe, READER_STREAM_SIZE);
+	if (!pipeline.buffers[1]) {
+		ppelib_set_error("Failed to allocate read buffer");
+		return;
+	}
+
+	read_direct(pe, 0, buffer, MIN(READER_STREAM_SIZE, pe->reader.size));
+
+	for (size_t offset = 0; offset < pe->reader.size && !ppelib_error_peek(); offset += READER_STREAM_SIZE) {
+		pipeline.offset = offset;
+		executor_run(executor, stream_pipeline_task, &pipeline, pe->reader.size - offset > READER_STREAM_SIZE ? 2 : 1);
+
+		if (pipeline.read_failed) {
+			ppelib_set_error("Failed to read file data");
+		} else if (pipeline.write_failed) {
+			ppelib_set_error("Failed to write data");
+		}
+	}
+
+	mem_free(pe, pipeline.buffers[1]);
+}
+
+// Feeds the file the handle was loaded from to the sink, straight from the buffer or in chunks from the reader.
+// Returns 0 when the handle has no file to read from.
+uint8_t stream_original_file(ppelib_file_t *pe, const ppelib_sink_t *sink, const ppelib_executor_t *executor) {
+	if (pe->file_buffer) {
+		if (sink->write(sink->context, 0, pe->file_buffer, pe->file_buffer_size) != pe->file_buffer_size) {
+			ppelib_set_error("Failed to write data");
+			return 0;
+		}
+		return 1;
+	}
+
+	if (!pe->reader.read_at) {
+		return 0;
+	}
+
+	uint8_t *buffer = mem_alloc(pe, READER_STREAM_SIZE);
+	if (!buffer) {
+		ppelib_set_error("Failed to allocate read buffer");
+		return 0;
+	}
+
+	lock_file(pe);
+
+	if (executor_concurrency(executor) > 1) {
+		stream_reader_pipelined(pe, sink, executor, buffer);
+	} else {
+		stream_reader(pe, sink, buffer);
+	}
+
+	unlock_file(pe);
+
+	mem_free(pe, buffer);
+	return !ppelib_error_peek();
+}
+
+// Returns the number of bytes needed to parse all headers, as far as can be told from the first size bytes
+size_t needed_headers_size(const uint8_t *buffer, size_t size) {
+	size_t needed = PE_SIGNATURE_OFFSET + sizeof(uint32_t);
+	if (size < needed) {
+		return needed;
+	}
+
+	size_t coff_header_offset = read_uint32_t(buffer + PE_SIGNATURE_OFFSET) + 4;
+	needed = coff_header_offset + COFF_HEADER_SIZE + sizeof(uint16_t);
+	if (size < needed) {
+		return needed;
+	}
+
+	uint16_t number_of_sections = read_uint16_t(buffer + coff_header_offset + 2);
+	uint16_t magic = read_uint16_t(buffer + coff_header_offset + COFF_HEADER_SIZE);
+
+	needed = coff_header_offset + COFF_HEADER_SIZE;
+	if (magic == PE32PLUS_MAGIC) {
+		needed += PEPLUS_OPTIONAL_HEADER_STANDARD_SIZE + PEPLUS_OPTIONAL_HEADER_WINDOWS_SIZE;
+	} else {
+		needed += PE_OPTIONAL_HEADER_STANDARD_SIZE + PE_OPTIONAL_HEADER_WINDOWS_SIZE;
+	}
+
+	if (size < needed) {
+		return needed;
+	}
+
+	size_t number_of_rva_and_sizes = read_uint32_t(buffer + needed - sizeof(uint32_t));
+
+	return needed + (number_of_rva_and_sizes * PE_HEADER_DATA_DIRECTORIES_SIZE)
+			+ (number_of_sections * PE_SECTION_HEADER_SIZE);
+}
+
+EXPORT_SYM ppelib_file_t* ppelib_create_from_reader(const ppelib_reader_t *reader) {
+	ppelib_reset_error();
+
+	if (!reader->read_at) {
+		ppelib_set_error("No read_at callback");
+		return NULL;
+	}
+
+	if (!reader->size) {
+		ppelib_set_error("Empty file");
+		return NULL;
+	}
+
+	ppelib_file_t *pe = ppelib_create();
+	if (ppelib_error_peek()) {
+		ppelib_destroy(pe);
+		return NULL;
+	}
+
+	memcpy(&pe->reader, reader, sizeof(ppelib_reader_t));
+
+	if (reader->cache_blocks) {
+		pe->block_cache.tags = mem_calloc(pe, sizeof(size_t) * reader->cache_blocks);
+		pe->block_cache.data = mem_alloc(pe, PPELIB_READER_BLOCK_SIZE * reader->cache_blocks);
+		if (!pe->block_cache.tags || !pe->block_cache.data) {
+			ppelib_set_error("Failed to allocate block cache");
+			ppelib_destroy(pe);
+			return NULL;
+		}
+		pe->block_cache.number_of_blocks = reader->cache_blocks;
+	}
+
+	uint8_t *headers = NULL;
+	size_t headers_size = 0;
+	size_t needed = MIN(reader->size, PPELIB_READER_BLOCK_SIZE);
+
+	while (needed > headers_size) {
+		uint8_t *oldptr = headers;
+		headers = mem_realloc(pe, headers, needed);
+		if (!headers) {
+			mem_free(pe, oldptr);
+			ppelib_set_error("Failed to allocate headers");
+			ppelib_destroy(pe);
+			return NULL;
+		}
+
+		reader_read(pe, headers_size, headers + headers_size, needed - headers_size);
+		if (ppelib_error_peek()) {
+			mem_free(pe, headers);
+			ppelib_destroy(pe);
+			return NULL;
+		}
+
+		headers_size = needed;
+		needed = MIN(needed_headers_size(headers, headers_size), reader->size);
+	}
+
+	parse_headers(pe, headers, headers_size, reader->size, CONTENTS_NONE);
+	if (ppelib_error_peek()) {
+		mem_free(pe, headers);
+		ppelib_destroy(pe);
+		return NULL;
+	}
+
+	pe->stub = arena_alloc(&pe->arena, pe->pe_header_offset);
+	if (!pe->stub) {
+		mem_free(pe, headers);
+		ppelib_set_error("Failed to allocate memory for PE stub");
+		ppelib_destroy(pe);
+		return NULL;
+	}
+	memcpy(pe->stub, headers, pe->pe_header_offset);
+	mem_free(pe, headers);
+
+	if (reader->size > pe->end_of_sections) {
+		pe->trailing_data_size = reader->size - pe->end_of_sections;
+	}
+
+	if (pe->header.number_of_rva_and_sizes > DIR_CERTIFICATE_TABLE) {
+		if (pe->header.data_directories[DIR_CERTIFICATE_TABLE].size) {
+			if (pe->header.data_directories[DIR_CERTIFICATE_TABLE].virtual_address < pe->end_of_sections) {
+				reader_load_certificate_table(pe);
+				if (ppelib_error_peek()) {
+					ppelib_destroy(pe);
+					return NULL;
+				}
+				pe->certificate_table_parsed = 1;
+			}
+		}
+	}
+
+	snapshot_image(pe);
+
+	return pe;
+}
@@ -0,0 +1,297 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-relocation-table.h>
+
+#include "main.h"
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "utils.h"
+
+#define RELOCATION_BLOCK_HEADER_SIZE 8
+
+// The first pass only counts blocks and entries, the second fills the arrays
+void walk_relocation_table(ppelib_relocation_table_t *table, const uint8_t *data, size_t size) {
+	size_t offset = 0;
+
+	table->number_of_blocks = 0;
+	table->number_of_relocations = 0;
+
+	while (size - offset >= RELOCATION_BLOCK_HEADER_SIZE) {
+		uint32_t page_rva = read_uint32_t(data + offset + 0);
+		uint32_t block_size = read_uint32_t(data + offset + 4);
+
+		if (block_size < RELOCATION_BLOCK_HEADER_SIZE || block_size > size - offset) {
+			ppelib_set_error("Invalid relocation block size");
+			return;
+		}
+
+		size_t number_of_entries = (block_size - RELOCATION_BLOCK_HEADER_SIZE) / sizeof(uint16_t);
+
+		if (table->blocks) {
+			ppelib_relocation_block_t *block = &table->blocks[table->number_of_blocks];
+			block->page_rva = page_rva;
+			block->first_relocation = table->number_of_relocations;
+			block->number_of_relocations = number_of_entries;
+
+			for (size_t i = 0; i < number_of_entries; ++i) {
+				uint16_t entry = read_uint16_t(data + offset + RELOCATION_BLOCK_HEADER_SIZE + (i * sizeof(uint16_t)));
+				ppelib_relocation_t *relocation = &table->relocations[table->number_of_relocations + i];
+
+				relocation->type = entry >> 12;
+				relocation->rva = page_rva + (entry & 0x0FFF);
+			}
+		}
+
+		table->number_of_blocks++;
+		table->number_of_relocations += number_of_entries;
+		offset += block_size;
+	}
+}
+
+void parse_relocation_table(ppelib_file_t *pe) {
+	ppelib_relocation_table_t *table = &pe->relocation_table;
+	memset(table, 0, sizeof(ppelib_relocation_table_t));
+
+	size_t table_rva = pe->header.data_directories[DIR_BASE_RELOCATION_TABLE].virtual_address;
+	size_t table_size = pe->header.data_directories[DIR_BASE_RELOCATION_TABLE].size;
+
+	size_t available;
+	const uint8_t *data = rva_to_pointer(pe, table_rva, &available);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	if (!data || available < table_size) {
+		ppelib_set_error("Relocation table outside of section");
+		return;
+	}
+
+	walk_relocation_table(table, data, table_size);
+	if (ppelib_error_peek()) {
+		memset(table, 0, sizeof(ppelib_relocation_table_t));
+		return;
+	}
+
+	table->blocks = arena_alloc(&pe->arena, sizeof(ppelib_relocation_block_t) * table->number_of_blocks);
+	table->relocations = arena_alloc(&pe->arena, sizeof(ppelib_relocation_t) * table->number_of_relocations);
+	if (!table->blocks || !table->relocations) {
+		ppelib_set_error("Failed to allocate relocation table");
+		memset(table, 0, sizeof(ppelib_relocation_table_t));
+		return;
+	}
+
+	walk_relocation_table(table, data, table_size);
+}
+
+// Finds the section the fixup applies to and its offset in the section contents. Returns 0 for padding and for
+// fixups outside of the file data, which the loader applies to zero filled memory.
+uint8_t fixup_target(ppelib_file_t *pe, const ppelib_relocation_t *relocation, uint16_t *section_index,
+		size_t *offset) {
+	size_t size;
+
+	switch (relocation->type) {
+	case IMAGE_REL_BASED_ABSOLUTE:
+		return 0;
+	case IMAGE_REL_BASED_HIGHLOW:
+		size = sizeof(uint32_t);
+		break;
+	case IMAGE_REL_BASED_DIR64:
+		size = sizeof(uint64_t);
+		break;
+	default:
+		ppelib_set_error("Unsupported relocation type");
+		return 0;
+	}
+
+	const ppelib_section_range_t *range = find_section_range(pe->sections_by_rva, pe->indexed_sections_by_rva,
+			relocation->rva);
+	if (!range || relocation->rva >= range->end) {
+		return 0;
+	}
+
+	const ppelib_section_t *section = pe->sections[range->index];
+	size_t data_size = MIN(section->virtual_size, section->size_of_raw_data);
+	*offset = relocation->rva - section->virtual_address;
+	if (*offset > data_size || size > data_size - *offset) {
+		return 0;
+	}
+
+	*section_index = range->index;
+	return 1;
+}
+
+// Groups the fixups into runs of one type in one section, so rebasing is a loop over plain offsets per run
+void decode_fixups(ppelib_file_t *pe) {
+	const ppelib_relocation_table_t *table = &pe->relocation_table;
+	size_t number_of_runs = 0;
+	size_t number_of_fixups = 0;
+
+	ppelib_fixup_run_t *run = NULL;
+	pe->fixup_runs = NULL;
+	pe->fixup_offsets = NULL;
+
+	for (uint8_t pass = 0; pass < 2; ++pass) {
+		number_of_runs = 0;
+		number_of_fixups = 0;
+		run = NULL;
+
+		for (size_t i = 0; i < table->number_of_relocations; ++i) {
+			const ppelib_relocation_t *relocation = &table->relocations[i];
+
+			uint16_t section_index;
+			size_t offset;
+			uint8_t applies = fixup_target(pe, relocation, &section_index, &offset);
+			if (ppelib_error_peek()) {
+				return;
+			}
+
+			if (!applies) {
+				continue;
+			}
+
+			if (!run || run->section_index != section_index || run->type != relocation->type) {
+				run = pe->fixup_runs ? &pe->fixup_runs[number_of_runs] : NULL;
+				number_of_runs++;
+
+				if (run) {
+					run->section_index = section_index;
+					run->type = relocation->type;
+					run->first_fixup = number_of_fixups;
+					run->number_of_fixups = 0;
+				}
+			}
+
+			if (run) {
+				pe->fixup_offsets[number_of_fixups] = offset;
+				run->number_of_fixups++;
+			}
+			number_of_fixups++;
+		}
+
+		if (!pass) {
+			pe->fixup_runs = arena_alloc(&pe->arena, sizeof(ppelib_fixup_run_t) * number_of_runs);
+			pe->fixup_offsets = arena_alloc(&pe->arena, sizeof(uint32_t) * number_of_fixups);
+			if (!pe->fixup_runs || !pe->fixup_offsets) {
+				ppelib_set_error("Failed to allocate fixups");
+				return;
+			}
+		}
+	}
+
+	pe->number_of_fixup_runs = number_of_runs;
+	pe->fixups_decoded = 1;
+}
+
+void apply_fixups_highlow(uint8_t *contents, const uint32_t *offsets, size_t number_of_fixups, uint32_t delta) {
+	for (size_t i = 0; i < number_of_fixups; ++i) {
+		uint32_t value;
+		memcpy(&value, contents + offsets[i], sizeof(uint32_t));
+		value += delta;
+		memcpy(contents + offsets[i], &value, sizeof(uint32_t));
+	}
+}
+
+void apply_fixups_dir64(uint8_t *contents, const uint32_t *offsets, size_t number_of_fixups, uint64_t delta) {
+	for (size_t i = 0; i < number_of_fixups; ++i) {
+		uint64_t value;
+		memcpy(&value, contents + offsets[i], sizeof(uint64_t));
+		value += delta;
+		memcpy(contents + offsets[i], &value, sizeof(uint64_t));
+	}
+}
+
+void load_relocation_table(ppelib_file_t *pe) {
+	if (pe->header.number_of_rva_and_sizes > DIR_BASE_RELOCATION_TABLE) {
+		if (pe->header.data_directories[DIR_BASE_RELOCATION_TABLE].size) {
+			parse_relocation_table(pe);
+		}
+	}
+}
+
+EXPORT_SYM ppelib_relocation_table_t* ppelib_get_relocation_table(ppelib_file_t *pe) {
+	ppelib_reset_error();
+
+	load_once(pe, &pe->relocation_table_parsed, &pe->relocation_table_error,
+			load_relocation_table);
+
+	return &pe->relocation_table;
+}
+
+EXPORT_SYM void ppelib_rebase(ppelib_file_t *pe, uint64_t image_base) {
+	ppelib_reset_error();
+
+	if (pe->header.magic != PE32PLUS_MAGIC && image_base > UINT32_MAX) {
+		ppelib_set_error("Image base out of range");
+		return;
+	}
+
+	uint64_t delta = image_base - pe->header.image_base;
+	if (!delta) {
+		return;
+	}
+
+	ppelib_get_relocation_table(pe);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	if (!pe->fixups_decoded) {
+		decode_fixups(pe);
+		if (ppelib_error_peek()) {
+			return;
+		}
+	}
+
+	// Make every section writable before changing anything, so a failure doesn't leave a half rebased image
+	for (size_t i = 0; i < pe->number_of_fixup_runs; ++i) {
+		ppelib_section_t *section = pe->sections[pe->fixup_runs[i].section_index];
+		size_t data_size = MIN(section->virtual_size, section->size_of_raw_data);
+
+		load_section_contents(pe, section);
+		if (ppelib_error_peek()) {
+			return;
+		}
+
+		if (!buffer_make_owned(pe, &section->contents, data_size)) {
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < pe->number_of_fixup_runs; ++i) {
+		const ppelib_fixup_run_t *run = &pe->fixup_runs[i];
+		ppelib_section_t *section = pe->sections[run->section_index];
+		const uint32_t *offsets = pe->fixup_offsets + run->first_fixup;
+
+		if (run->type == IMAGE_REL_BASED_DIR64) {
+			apply_fixups_dir64(section->contents, offsets, run->number_of_fixups, delta);
+		} else {
+			apply_fixups_highlow(section->contents, offsets, run->number_of_fixups, (uint32_t)delta);
+		}
+
+		mark_dirty(pe, section->pointer_to_raw_data, MIN(section->virtual_size, section->size_of_raw_data));
+	}
+
+	invalidate_stats(&pe->section_stats);
+	pe->header.image_base = image_base;
+}
@@ -25,12 +25,48 @@
 
 #include "main.h"
 #include "ppelib-error.h"
+#include "ppelib-internal.h"
 #include "export.h"
 #include "utils.h"
 
-_Thread_local size_t t_max_size;
-_Thread_local size_t t_rscs_base;
-_Thread_local uint8_t t_parse_error_handled;
+#define RESOURCE_MIN_SUBTREES_PER_TASK 32
+
+// A directory whose parse was put off to run on the executor, with the arguments parse_directory_table() would have
+// been called with
+typedef struct resource_subtree {
+	ppelib_resource_table_t *table;
+	size_t offset;
+	size_t depth;
+} resource_subtree_t;
+
+// Everything the recursive parse needs besides the handle, nothing is kept outside of the parse itself
+typedef struct resource_parser {
+	ppelib_file_t *pe;
+	ppelib_arena_t *arena;
+
+	size_t max_size;
+	size_t rscs_base;
+	uint8_t borrowed;
+	uint8_t error_handled;
+
+	// When set, the sub-directories of directories at this depth are collected in subtrees instead of parsed
+	size_t defer_depth;
+	resource_subtree_t *subtrees;
+	size_t number_of_subtrees;
+	size_t subtrees_size;
+} resource_parser_t;
+
+typedef struct resource_task {
+	resource_parser_t parser;
+	ppelib_arena_t arena;
+
+	const resource_subtree_t *subtrees;
+	size_t number_of_subtrees;
+
+	uint8_t *buffer;
+	size_t size;
+	uint8_t failed;
+} resource_task_t;
 
 typedef struct string_table_string {
 	size_t offset;
@@ -49,7 +85,6 @@ typedef struct string_table {
 } string_table_t;
 
 size_t put_string(const wchar_t *string, uint8_t *buffer);
-void free_resource_directory_table(ppelib_resource_table_t *table);
 
 void string_table_serialize(string_table_t *table, uint8_t *buffer) {
 	for (size_t i = 0; i < table->size; ++i) {
@@ -96,7 +131,7 @@ void string_table_put(string_table_t *table, wchar_t *string) {
 	table->size++;
 	table->bytes += s_size;
 
-	table->strings = realloc(table->strings, sizeof(string_table_string_t) * table->size);
+	table->strings = mem_realloc(NULL, table->strings, sizeof(string_table_string_t) * table->size);
 	table->strings[table->size - 1].string = string;
 
 	table->strings[table->size - 1].bytes = s_size;
@@ -113,7 +148,7 @@ void string_table_put(string_table_t *table, wchar_t *string) {
 }
 
 void string_table_free(string_table_t *table) {
-	free(table->strings);
+	mem_free(NULL, table->strings);
 }
 
 size_t table_length(const ppelib_resource_table_t *resource_table, size_t in_size) {
@@ -299,30 +334,30 @@ size_t serialize_resource_table(const ppelib_resource_table_t *resource_table, u
 	return size;
 }
 
-wchar_t* get_string(uint8_t *buffer, size_t offset) {
-	if (offset + 2 > t_max_size) {
+wchar_t* get_string(resource_parser_t *parser, uint8_t *buffer, size_t offset) {
+	if (offset + 2 > parser->max_size) {
 		ppelib_set_error("Section too small for string");
-		t_parse_error_handled = 0;
+		parser->error_handled = 0;
 		return NULL;
 	}
 
 	uint16_t size = read_uint16_t(buffer + offset + 0);
 
-	if (offset + 2 + (size * 2) > t_max_size) {
+	if (offset + 2 + (size * 2) > parser->max_size) {
 		ppelib_set_error("Section too small for string");
-		t_parse_error_handled = 0;
+		parser->error_handled = 0;
 		return NULL;
 	}
 
-	wchar_t *string = calloc((size + 1) * sizeof(wchar_t), 1);
+	wchar_t *string = arena_calloc(parser->arena, (size + 1) * sizeof(wchar_t));
 	if (!string) {
 		ppelib_set_error("Failed to allocate string");
-		t_parse_error_handled = 0;
+		parser->error_handled = 0;
 		return NULL;
 	}
 
 	if (sizeof(wchar_t) == 2) {
-		memcpy(string, buffer + 2, size * 2);
+		memcpy(string, buffer + offset + 2, size * 2);
 	} else {
 		for (uint16_t i = 0; i < size; ++i) {
 			memcpy(string + i, buffer + offset + 2 + (i * 2), 2);
@@ -336,22 +371,29 @@ size_t put_string(const wchar_t *string, uint8_t *buffer) {
 
 }
 
-size_t parse_data_entry(ppelib_resource_data_t *data_entry, uint8_t *buffer, size_t offset) {
-	uint32_t data_rva = read_uint32_t(buffer + offset + 0) - t_rscs_base;
+size_t parse_data_entry(resource_parser_t *parser, ppelib_resource_data_t *data_entry, uint8_t *buffer,
+		size_t offset) {
+	uint32_t data_rva = read_uint32_t(buffer + offset + 0) - parser->rscs_base;
 	data_entry->size = read_uint32_t(buffer + offset + 4);
 	data_entry->codepage = read_uint32_t(buffer + offset + 8);
 	data_entry->reserved = read_uint32_t(buffer + offset + 12);
 
-	if (data_rva > t_max_size || data_entry->size > t_max_size || data_rva + data_entry->size > t_max_size) {
+	size_t max_size = parser->max_size;
+	if (data_rva > max_size || data_entry->size > max_size || data_rva + data_entry->size > max_size) {
 		ppelib_set_error("Section too small for resource data entry data");
-		t_parse_error_handled = 0;
+		parser->error_handled = 0;
 		return 0;
 	}
 
-	data_entry->data = malloc(data_entry->size);
+	if (parser->borrowed) {
+		data_entry->data = buffer + data_rva;
+		return data_rva + data_entry->size;
+	}
+
+	data_entry->data = arena_alloc(parser->arena, data_entry->size);
 	if (!data_entry->data) {
 		ppelib_set_error("Failed to allocate resource data");
-		t_parse_error_handled = 0;
+		parser->error_handled = 0;
 		return 0;
 	}
 
@@ -360,12 +402,35 @@ size_t parse_data_entry(ppelib_resource_data_t *data_entry, uint8_t *buffer, siz
 	return data_rva + data_entry->size;
 }
 
-size_t parse_directory_table(ppelib_resource_table_t *resource_table, uint8_t *buffer, size_t offset, size_t depth) {
+void defer_subtree(resource_parser_t *parser, ppelib_resource_table_t *table, size_t offset, size_t depth) {
+	if (parser->number_of_subtrees == parser->subtrees_size) {
+		size_t subtrees_size = MAX(parser->subtrees_size * 2, 64);
+
+		resource_subtree_t *subtrees = mem_realloc(parser->pe, parser->subtrees,
+				sizeof(resource_subtree_t) * subtrees_size);
+		if (!subtrees) {
+			ppelib_set_error("Failed to allocate resource sub-directory list");
+			parser->error_handled = 0;
+			return;
+		}
+
+		parser->subtrees = subtrees;
+		parser->subtrees_size = subtrees_size;
+	}
+
+	resource_subtree_t *subtree = &parser->subtrees[parser->number_of_subtrees++];
+	subtree->table = table;
+	subtree->offset = offset;
+	subtree->depth = depth;
+}
+
+size_t parse_directory_table(resource_parser_t *parser, ppelib_resource_table_t *resource_table, uint8_t *buffer,
+		size_t offset, size_t depth) {
 	depth++;
 
 	if (depth > 10) {
 		ppelib_set_error("Parse depth (10) exceeded");
-		t_parse_error_handled = 0;
+		parser->error_handled = 0;
 		return 0;
 	}
 
@@ -383,13 +448,30 @@ size_t parse_directory_table(ppelib_resource_table_t *resource_table, uint8_t *b
 
 	size_t min_space = (number_of_name_entries + number_of_id_entries) * 8;
 
-	if (offset + 16 + min_space > t_max_size) {
+	if (offset + 16 + min_space > parser->max_size) {
 		ppelib_set_error("Section too small for resource table (no space for directory contents)");
-		t_parse_error_handled = 0;
+		parser->error_handled = 0;
 		return 0;
 	}
 
 	uint8_t *entries = table + 16;
+
+	size_t subdirectories = 0;
+	for (uint16_t i = 0; i < number_of_name_entries + number_of_id_entries; ++i) {
+		if (CHECK_BIT(read_uint32_t(entries + (i * 8) + 4), HIGH_BIT32)) {
+			subdirectories++;
+		}
+	}
+	size_t data_entries = number_of_name_entries + number_of_id_entries - subdirectories;
+
+	resource_table->subdirectories = arena_alloc(parser->arena, sizeof(void*) * subdirectories);
+	resource_table->data_entries = arena_alloc(parser->arena, sizeof(void*) * data_entries);
+	if (!resource_table->subdirectories || !resource_table->data_entries) {
+		ppelib_set_error("Failed to allocate resource directory entries");
+		parser->error_handled = 0;
+		return 0;
+	}
+
 	for (uint16_t i = 0; i < number_of_name_entries + number_of_id_entries; ++i) {
 
 		uint32_t name_offset_or_id = read_uint32_t(entries + 0);
@@ -398,7 +480,7 @@ size_t parse_directory_table(ppelib_resource_table_t *resource_table, uint8_t *b
 
 		wchar_t *name = NULL;
 		if (CHECK_BIT(name_offset_or_id, HIGH_BIT32)) {
-			name = get_string(buffer, name_offset_or_id ^ HIGH_BIT32);
+			name = get_string(parser, buffer, name_offset_or_id ^ HIGH_BIT32);
 			if (ppelib_error_peek()) {
 				return 0;
 			}
@@ -407,31 +489,16 @@ size_t parse_directory_table(ppelib_resource_table_t *resource_table, uint8_t *b
 		if (CHECK_BIT(entry_offset, HIGH_BIT32)) {
 			entry_offset = entry_offset ^ HIGH_BIT32;
 
-			if (offset + 16 + entry_offset + 16 > t_max_size) {
-				free(name);
+			if (offset + 16 + entry_offset + 16 > parser->max_size) {
 				ppelib_set_error("Section too small for sub-directory");
-				t_parse_error_handled = 0;
-				return 0;
-			}
-
-			resource_table->subdirectories_number++;
-			size_t subdirs = resource_table->subdirectories_number;
-
-			void *oldptr = resource_table->subdirectories;
-			resource_table->subdirectories = realloc(resource_table->subdirectories, sizeof(void*) * subdirs);
-			if (!resource_table->subdirectories) {
-				resource_table->subdirectories = oldptr;
-				resource_table->subdirectories_number--;
-				ppelib_set_error("Failed to allocate resource sub-directory entry");
+				parser->error_handled = 0;
 				return 0;
 			}
 
-			resource_table->subdirectories[subdirs - 1] = calloc(sizeof(ppelib_resource_table_t), 1);
-			ppelib_resource_table_t *subdir = resource_table->subdirectories[subdirs - 1];
-
+			ppelib_resource_table_t *subdir = arena_calloc(parser->arena, sizeof(ppelib_resource_table_t));
 			if (!subdir) {
 				ppelib_set_error("Failed to allocate resource sub-directory entry");
-				t_parse_error_handled = 0;
+				parser->error_handled = 0;
 				return 0;
 			}
 
@@ -441,19 +508,21 @@ size_t parse_directory_table(ppelib_resource_table_t *resource_table, uint8_t *b
 				subdir->resource_type = name_offset_or_id;
 			}
 
-			size_t subdir_size = parse_directory_table(subdir, buffer, entry_offset, depth);
-			if (ppelib_error_peek()) {
-				if (!t_parse_error_handled) {
-					t_parse_error_handled = 1;
+			resource_table->subdirectories[resource_table->subdirectories_number++] = subdir;
 
-					free(name);
-					resource_table->subdirectories_number--;
-					subdirs = resource_table->subdirectories_number;
-
-					free_resource_directory_table(resource_table->subdirectories[subdirs]);
-					free(resource_table->subdirectories[subdirs]);
+			if (depth == parser->defer_depth) {
+				defer_subtree(parser, subdir, entry_offset, depth);
+				if (ppelib_error_peek()) {
+					return 0;
+				}
+				continue;
+			}
 
-					resource_table->subdirectories = realloc(resource_table->subdirectories, sizeof(void*) * subdirs);
+			size_t subdir_size = parse_directory_table(parser, subdir, buffer, entry_offset, depth);
+			if (ppelib_error_peek()) {
+				if (!parser->error_handled) {
+					parser->error_handled = 1;
+					resource_table->subdirectories_number--;
 				}
 				return 0;
 			}
@@ -461,28 +530,13 @@ size_t parse_directory_table(ppelib_resource_table_t *resource_table, uint8_t *b
 			size = MAX(size, subdir_size);
 
 		} else {
-			if (offset + 16 + entry_offset + 16 > t_max_size) {
-				free(name);
+			if (offset + 16 + entry_offset + 16 > parser->max_size) {
 				ppelib_set_error("Section too small for data entry");
-				t_parse_error_handled = 0;
+				parser->error_handled = 0;
 				return 0;
 			}
 
-			resource_table->data_entries_number++;
-			size_t datas = resource_table->data_entries_number;
-
-			void *oldptr = resource_table->data_entries;
-			resource_table->data_entries = realloc(resource_table->data_entries, sizeof(void*) * datas);
-
-			if (!resource_table->data_entries) {
-				resource_table->data_entries = oldptr;
-				resource_table->data_entries_number--;
-				ppelib_set_error("Failed to allocate resource data entry");
-				return 0;
-			}
-
-			resource_table->data_entries[datas - 1] = calloc(sizeof(ppelib_resource_data_t), 1);
-			ppelib_resource_data_t *data_entry = resource_table->data_entries[datas - 1];
+			ppelib_resource_data_t *data_entry = arena_calloc(parser->arena, sizeof(ppelib_resource_data_t));
 			if (!data_entry) {
 				ppelib_set_error("Failed to allocate resource data entry");
 				return 0;
@@ -494,16 +548,13 @@ size_t parse_directory_table(ppelib_resource_table_t *resource_table, uint8_t *b
 				data_entry->resource_type = name_offset_or_id;
 			}
 
-			size_t data_size = parse_data_entry(data_entry, buffer, entry_offset);
-			if (ppelib_error_peek()) {
-				if (!t_parse_error_handled) {
-					t_parse_error_handled = 1;
+			resource_table->data_entries[resource_table->data_entries_number++] = data_entry;
 
-					free(name);
+			size_t data_size = parse_data_entry(parser, data_entry, buffer, entry_offset);
+			if (ppelib_error_peek()) {
+				if (!parser->error_handled) {
+					parser->error_handled = 1;
 					resource_table->data_entries_number--;
-					free(resource_table->data_entries[resource_table->data_entries_number]);
-					resource_table->data_entries = realloc(resource_table->data_entries,
-							sizeof(void*) * resource_table->data_entries_number);
 
 					return 0;
 				}
@@ -516,9 +567,103 @@ size_t parse_directory_table(ppelib_resource_table_t *resource_table, uint8_t *b
 	return size;
 }
 
-size_t parse_resource_table(ppelib_file_t *pe) {
+// Tasks run on any thread and report failure through task->failed only. A thread that already has an error, left
+// over from whatever else it ran, keeps it untouched: the parse couldn't tell it apart from its own, so the batch
+// counts as failed and the serial parse takes over. Otherwise the thread is put back to having no error.
+void parse_resource_task(void *argument, size_t index) {
+	resource_task_t *task = (resource_task_t*)argument + index;
+
+	if (ppelib_error_peek()) {
+		task->failed = 1;
+		return;
+	}
+
+	for (size_t i = 0; i < task->number_of_subtrees && !task->failed; ++i) {
+		const resource_subtree_t *subtree = &task->subtrees[i];
+
+		size_t size = parse_directory_table(&task->parser, subtree->table, task->buffer, subtree->offset,
+				subtree->depth);
+		task->size = MAX(task->size, size);
+		task->failed = ppelib_error_peek();
+	}
+
+	// The error is the task's own, the thread had none when it came in
+	if (task->failed) {
+		ppelib_reset_error();
+	}
+}
+
+// Parses the root and type directories on the calling thread and the name directories below them in batches on the
+// executor, every batch into an arena of its own. The tree only takes the arenas over when everything parsed, on
+// failure nothing is kept and 0 is returned.
+uint8_t parse_resource_table_parallel(resource_parser_t *parser, uint8_t *buffer, const ppelib_executor_t *executor,
+		size_t *size) {
+	ppelib_file_t *pe = parser->pe;
+
+	ppelib_arena_t arena = { pe->arena.allocator, NULL };
+	resource_parser_t directories = *parser;
+	directories.arena = &arena;
+	directories.defer_depth = 2;
+
+	*size = parse_directory_table(&directories, &pe->resource_table, buffer, 0, 0);
+	if (ppelib_error_peek()) {
+		mem_free(pe, directories.subtrees);
+		arena_destroy(&arena);
+		return 0;
+	}
+
+	// Enough batches for the executor to even out subtrees of very different sizes, but not one per subtree
+	size_t number_of_tasks = MIN(executor_concurrency(executor) * 4,
+			directories.number_of_subtrees / RESOURCE_MIN_SUBTREES_PER_TASK);
+	number_of_tasks = MAX(number_of_tasks, 1);
+
+	resource_task_t *tasks = mem_calloc(pe, sizeof(resource_task_t) * number_of_tasks);
+	if (!tasks) {
+		mem_free(pe, directories.subtrees);
+		arena_destroy(&arena);
+		return 0;
+	}
+
+	for (size_t i = 0; i < number_of_tasks; ++i) {
+		resource_task_t *task = &tasks[i];
+		size_t first = (directories.number_of_subtrees * i) / number_of_tasks;
+		size_t last = (directories.number_of_subtrees * (i + 1)) / number_of_tasks;
+
+		task->arena.allocator = pe->arena.allocator;
+		task->parser = *parser;
+		task->parser.arena = &task->arena;
+		task->subtrees = directories.subtrees + first;
+		task->number_of_subtrees = last - first;
+		task->buffer = buffer;
+	}
+
+	executor_run(executor, parse_resource_task, tasks, number_of_tasks);
+
+	uint8_t failed = 0;
+	for (size_t i = 0; i < number_of_tasks; ++i) {
+		failed |= tasks[i].failed;
+		*size = MAX(*size, tasks[i].size);
+	}
+
+	if (failed) {
+		for (size_t i = 0; i < number_of_tasks; ++i) {
+			arena_destroy(&tasks[i].arena);
+		}
+		arena_destroy(&arena);
+	} else {
+		for (size_t i = 0; i < number_of_tasks; ++i) {
+			arena_merge(&pe->arena, &tasks[i].arena);
+		}
+		arena_merge(&pe->arena, &arena);
+	}
+
+	mem_free(pe, tasks);
+	mem_free(pe, directories.subtrees);
+	return !failed;
+}
+
+size_t parse_resource_table(ppelib_file_t *pe, const ppelib_executor_t *executor) {
 	ppelib_reset_error();
-	t_parse_error_handled = 0;
 
 	if (pe->header.number_of_rva_and_sizes < DIR_RESOURCE_TABLE) {
 		ppelib_set_error("No resource table found (too few directory entries).");
@@ -545,44 +690,175 @@ size_t parse_resource_table(ppelib_file_t *pe) {
 		return 0;
 	}
 
+	uint8_t *contents = load_section_contents(pe, section);
+	if (ppelib_error_peek()) {
+		return 0;
+	}
+
 	memset(&pe->resource_table, 0, sizeof(ppelib_resource_table_t));
 	pe->resource_table.root = 1;
-	uint8_t *data_table = section->contents + table_offset;
+	uint8_t *data_table = contents + table_offset;
 
 	if (table_offset + 16 > data_size) {
 		ppelib_set_error("Section too small for table. (No room for directory table)");
 		return 0;
 	}
 
-	t_max_size = data_size;
-	t_rscs_base = pe->data_directories[DIR_RESOURCE_TABLE].orig_rva;
+	resource_parser_t parser = { 0 };
+	parser.pe = pe;
+	parser.arena = &pe->arena;
+	parser.max_size = data_size;
+	parser.rscs_base = pe->data_directories[DIR_RESOURCE_TABLE].orig_rva;
+	parser.borrowed = buffer_is_borrowed(pe, data_table);
+
+	if (executor_concurrency(executor) > 1) {
+		size_t size;
+		if (parse_resource_table_parallel(&parser, data_table, executor, &size)) {
+			return size;
+		}
+
+		// Whatever went wrong is found again the same way, along with the same partial tree
+		memset(&pe->resource_table, 0, sizeof(ppelib_resource_table_t));
+		pe->resource_table.root = 1;
+		ppelib_reset_error();
+	}
+
+	return parse_directory_table(&parser, &pe->resource_table, data_table, 0, 0);
+}
 
-	return parse_directory_table(&pe->resource_table, data_table, 0, 0);
+// The whole tree lives in the handle's arena
+void free_resource_directory(ppelib_file_t *pe) {
+	memset(&pe->resource_table, 0, sizeof(ppelib_resource_table_t));
 }
 
-void free_resource_directory_table(ppelib_resource_table_t *table) {
-	for (size_t i = 0; i < table->data_entries_number; ++i) {
-		free(table->data_entries[i]->data);
-		free(table->data_entries[i]->name);
-		free(table->data_entries[i]);
+// Names sort before IDs, like the entries in a resource directory
+int compare_resource_ids(const ppelib_resource_id_t *a, const ppelib_resource_id_t *b) {
+	if (a->name && b->name) {
+		return wcscmp(a->name, b->name);
 	}
 
-	free(table->data_entries);
-	table->data_entries_number = 0;
+	if (a->name || b->name) {
+		return a->name ? -1 : 1;
+	}
 
-	for (size_t i = 0; i < table->subdirectories_number; ++i) {
-		free_resource_directory_table(table->subdirectories[i]);
-		free(table->subdirectories[i]->name);
-		free(table->subdirectories[i]);
+	if (a->id != b->id) {
+		return a->id < b->id ? -1 : 1;
 	}
 
-	free(table->subdirectories);
-	table->subdirectories_number = 0;
+	return 0;
 }
 
-void free_resource_directory(ppelib_file_t *pe) {
+// Compares the type, the name and the language, stopping after levels fields
+int compare_resource_entries(const ppelib_resource_entry_t *a, const ppelib_resource_entry_t *b, uint8_t levels) {
+	int retval = compare_resource_ids(&a->type, &b->type);
+	if (retval || levels == 1) {
+		return retval;
+	}
+
+	retval = compare_resource_ids(&a->name, &b->name);
+	if (retval || levels == 2) {
+		return retval;
+	}
+
+	if (a->language != b->language) {
+		return a->language < b->language ? -1 : 1;
+	}
+
+	return 0;
+}
+
+int compare_resource_entries_qsort(const void *a, const void *b) {
+	return compare_resource_entries(a, b, 3);
+}
+
+ppelib_resource_id_t resource_table_id(const ppelib_resource_table_t *table) {
+	ppelib_resource_id_t retval = { table->name, table->name ? 0 : table->resource_type };
+	return retval;
+}
+
+// Flattens the type / name / language levels of the tree into one sorted array. Files are supposed to have their
+// directories sorted already, but nothing enforces that, so the array is sorted anyway.
+void build_resource_index(ppelib_file_t *pe) {
+	const ppelib_resource_table_t *root = &pe->resource_table;
+	size_t number_of_resources = 0;
+
+	for (size_t t = 0; t < root->subdirectories_number; ++t) {
+		const ppelib_resource_table_t *type = root->subdirectories[t];
+
+		for (size_t n = 0; n < type->subdirectories_number; ++n) {
+			number_of_resources += type->subdirectories[n]->data_entries_number;
+		}
+	}
+
+	pe->resources = arena_alloc(&pe->arena, sizeof(ppelib_resource_entry_t) * number_of_resources);
+	if (!pe->resources) {
+		ppelib_set_error("Failed to allocate resource index");
+		return;
+	}
+
+	for (size_t t = 0; t < root->subdirectories_number; ++t) {
+		const ppelib_resource_table_t *type = root->subdirectories[t];
 
-	free_resource_directory_table(&pe->resource_table);
+		for (size_t n = 0; n < type->subdirectories_number; ++n) {
+			const ppelib_resource_table_t *name = type->subdirectories[n];
+
+			for (size_t l = 0; l < name->data_entries_number; ++l) {
+				ppelib_resource_entry_t *entry = &pe->resources[pe->number_of_resources++];
+
+				entry->type = resource_table_id(type);
+				entry->name = resource_table_id(name);
+				entry->language = name->data_entries[l]->resource_type;
+				entry->data = name->data_entries[l];
+			}
+		}
+	}
+
+	qsort(pe->resources, pe->number_of_resources, sizeof(ppelib_resource_entry_t), compare_resource_entries_qsort);
+}
+
+// Returns the index of the first entry not less than key, or of the first entry greater than key when upper is set
+size_t resource_index_search(const ppelib_file_t *pe, const ppelib_resource_entry_t *key, uint8_t levels,
+		uint8_t upper) {
+	size_t low = 0;
+	size_t high = pe->number_of_resources;
+
+	while (low < high) {
+		size_t mid = low + ((high - low) / 2);
+		int retval = compare_resource_entries(&pe->resources[mid], key, levels);
+
+		if (retval < 0 || (upper && retval == 0)) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+uint8_t load_resource_index(ppelib_file_t *pe) {
+	if (atomic_load_explicit(&pe->resource_index_built, memory_order_acquire)) {
+		return 1;
+	}
+
+	ppelib_get_resource_table(pe);
+	if (ppelib_error_peek()) {
+		return 0;
+	}
+
+	// Not load_once(), a failed build is tried again on the next lookup
+	lock_file(pe);
+	if (!atomic_load_explicit(&pe->resource_index_built, memory_order_relaxed)) {
+		build_resource_index(pe);
+		if (ppelib_error_peek()) {
+			pe->number_of_resources = 0;
+		} else {
+			atomic_store_explicit(&pe->resource_index_built, 1, memory_order_release);
+		}
+	}
+	unlock_file(pe);
+
+	return !ppelib_error_peek();
 }
 
 void print_resource_directory_data(const ppelib_resource_data_t *data, uint16_t indent) {
@@ -623,14 +899,90 @@ void print_resource_table(const ppelib_resource_table_t *table, uint16_t indent)
 	}
 }
 
-EXPORT_SYM ppelib_resource_table_t* ppelib_get_resource_table(ppelib_file_t *pe) {
+void load_resource_table(ppelib_file_t *pe, const ppelib_executor_t *executor) {
+	if (pe->header.number_of_rva_and_sizes > DIR_RESOURCE_TABLE) {
+		if (pe->header.data_directories[DIR_RESOURCE_TABLE].size) {
+			parse_resource_table(pe, executor);
+		}
+	}
+}
+
+// Like load_once(), which has no way to pass the executor along
+EXPORT_SYM ppelib_resource_table_t* ppelib_get_resource_table_with_executor(ppelib_file_t *pe,
+		const ppelib_executor_t *executor) {
 	ppelib_reset_error();
 
+	if (!atomic_load_explicit(&pe->resource_table_parsed, memory_order_acquire)) {
+		lock_file(pe);
+		if (!atomic_load_explicit(&pe->resource_table_parsed, memory_order_relaxed)) {
+			load_resource_table(pe, executor);
+			pe->resource_table_error = keep_load_error(pe);
+			atomic_store_explicit(&pe->resource_table_parsed, 1, memory_order_release);
+		}
+		unlock_file(pe);
+	}
+
+	if (pe->resource_table_error) {
+		ppelib_restore_error(pe->resource_table_error);
+	}
+
 	return &pe->resource_table;
 }
 
+EXPORT_SYM ppelib_resource_table_t* ppelib_get_resource_table(ppelib_file_t *pe) {
+	ppelib_reset_error();
+
+	return ppelib_get_resource_table_with_executor(pe, NULL);
+}
+
 EXPORT_SYM void ppelib_print_resource_table(const ppelib_resource_table_t *resource_table) {
 	ppelib_reset_error();
 
 	print_resource_table(resource_table, 0);
 }
+
+EXPORT_SYM ppelib_resource_data_t* ppelib_resource_find(ppelib_file_t *pe, ppelib_resource_id_t type,
+		ppelib_resource_id_t name, uint32_t language) {
+	ppelib_reset_error();
+
+	if (!load_resource_index(pe)) {
+		return NULL;
+	}
+
+	uint8_t any_language = (language == PPELIB_RESOURCE_ANY_LANGUAGE);
+	ppelib_resource_entry_t key = { type, name, any_language ? 0 : language, NULL };
+
+	size_t index = resource_index_search(pe, &key, 3, 0);
+	if (index < pe->number_of_resources) {
+		const ppelib_resource_entry_t *entry = &pe->resources[index];
+
+		if (compare_resource_entries(entry, &key, any_language ? 2 : 3) == 0) {
+			return entry->data;
+		}
+	}
+
+	ppelib_set_error("Resource not found");
+	return NULL;
+}
+
+EXPORT_SYM const ppelib_resource_entry_t* ppelib_resource_find_type(ppelib_file_t *pe, ppelib_resource_id_t type,
+		size_t *count) {
+	ppelib_reset_error();
+
+	*count = 0;
+
+	if (!load_resource_index(pe)) {
+		return NULL;
+	}
+
+	ppelib_resource_entry_t key = { type, { NULL, 0 }, 0, NULL };
+
+	size_t first = resource_index_search(pe, &key, 1, 0);
+	size_t last = resource_index_search(pe, &key, 1, 1);
+	if (first == last) {
+		return NULL;
+	}
+
+	*count = last - first;
+	return &pe->resources[first];
+}
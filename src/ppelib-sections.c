@@ -49,14 +49,27 @@ void ppelib_section_excise(ppelib_file_t *pe, uint16_t section_index, size_t sta
 		return;
 	}
 
-	uint16_t retval = buffer_excise(&pe->sections[section_index]->contents, data_size, start, end);
-	if (!retval) {
+	load_section_contents(pe, section);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	if (!buffer_make_owned(pe, &section->contents, data_size)) {
+		return;
+	}
+
+	uint16_t retval = buffer_excise(pe, &pe->sections[section_index]->contents, data_size, start, end);
+	if (retval) {
 		ppelib_set_error("Failed to allocate new section contents");
 		return;
 	}
 
 	section->virtual_size -= (end - start);
 	section->size_of_raw_data = TO_NEAREST(section->virtual_size, pe->header.file_alignment);
+	pe->fixups_decoded = 0;
+	invalidate_stats(&pe->section_stats);
+
+	build_section_index(pe);
 }
 
 void ppelib_section_resize(ppelib_file_t *pe, uint16_t section_index, size_t size) {
@@ -75,13 +88,24 @@ void ppelib_section_resize(ppelib_file_t *pe, uint16_t section_index, size_t siz
 		return;
 	}
 
+	load_section_contents(pe, section);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	if (!buffer_make_owned(pe, &section->contents, data_size)) {
+		return;
+	}
+
 	uint8_t *oldptr = section->contents;
-	section->contents = realloc(section->contents, size);
+	section->contents = mem_realloc(pe, section->contents, size);
 	if (!section->contents) {
 		ppelib_set_error("Failed to allocate new section contents");
 		section->contents = oldptr;
 		return;
 	}
+
+	invalidate_stats(&pe->section_stats);
 }
 
 uint16_t ppelib_section_find_index(ppelib_file_t *pe, ppelib_section_t *section) {
@@ -96,3 +120,312 @@ uint16_t ppelib_section_find_index(ppelib_file_t *pe, ppelib_section_t *section)
 	ppelib_set_error("Section not found");
 	return 0;
 }
+
+int compare_section_ranges(const void *a, const void *b) {
+	const ppelib_section_range_t *ra = a;
+	const ppelib_section_range_t *rb = b;
+
+	if (ra->start != rb->start) {
+		return ra->start < rb->start ? -1 : 1;
+	}
+
+	return ra->index < rb->index ? -1 : 1;
+}
+
+// Sorted by RVA and by file offset, so both directions can be translated with a binary search
+void build_section_index(ppelib_file_t *pe) {
+	size_t number_of_sections = pe->header.number_of_sections;
+
+	if (number_of_sections > pe->allocated_section_index) {
+		pe->sections_by_rva = arena_alloc(&pe->arena, sizeof(ppelib_section_range_t) * number_of_sections);
+		pe->sections_by_offset = arena_alloc(&pe->arena, sizeof(ppelib_section_range_t) * number_of_sections);
+		if (!pe->sections_by_rva || !pe->sections_by_offset) {
+			pe->allocated_section_index = 0;
+			pe->indexed_sections_by_rva = 0;
+			pe->indexed_sections_by_offset = 0;
+			ppelib_set_error("Failed to allocate section index");
+			return;
+		}
+
+		pe->allocated_section_index = number_of_sections;
+	}
+
+	pe->indexed_sections_by_rva = 0;
+	pe->indexed_sections_by_offset = 0;
+
+	for (uint16_t i = 0; i < number_of_sections; ++i) {
+		ppelib_section_t *section = pe->sections[i];
+
+		ppelib_section_range_t *range = &pe->sections_by_rva[pe->indexed_sections_by_rva++];
+		range->start = section->virtual_address;
+		range->end = range->start + MAX(section->virtual_size, section->size_of_raw_data);
+		range->index = i;
+
+		if (section->size_of_raw_data) {
+			range = &pe->sections_by_offset[pe->indexed_sections_by_offset++];
+			range->start = section->pointer_to_raw_data;
+			range->end = range->start + section->size_of_raw_data;
+			range->index = i;
+		}
+	}
+
+	qsort(pe->sections_by_rva, pe->indexed_sections_by_rva, sizeof(ppelib_section_range_t), compare_section_ranges);
+	qsort(pe->sections_by_offset, pe->indexed_sections_by_offset, sizeof(ppelib_section_range_t),
+			compare_section_ranges);
+}
+
+// Returns the last range starting at or before value, or NULL
+const ppelib_section_range_t* find_section_range(const ppelib_section_range_t *ranges, size_t number_of_ranges,
+		size_t value) {
+	size_t low = 0;
+	size_t high = number_of_ranges;
+
+	while (low < high) {
+		size_t mid = low + ((high - low) / 2);
+
+		if (ranges[mid].start <= value) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	if (!low) {
+		return NULL;
+	}
+
+	return &ranges[low - 1];
+}
+
+ppelib_section_t* section_for_rva(const ppelib_file_t *pe, size_t rva) {
+	const ppelib_section_range_t *range = find_section_range(pe->sections_by_rva, pe->indexed_sections_by_rva, rva);
+	if (!range || rva >= range->end) {
+		return NULL;
+	}
+
+	return pe->sections[range->index];
+}
+
+// Returns the section data at rva and sets available to the number of bytes that can be read from there. Loads the
+// section contents when needed. Returns NULL when rva isn't backed by section data.
+const uint8_t* rva_to_pointer(ppelib_file_t *pe, size_t rva, size_t *available) {
+	*available = 0;
+
+	ppelib_section_t *section = section_for_rva(pe, rva);
+	if (!section) {
+		return NULL;
+	}
+
+	size_t data_size = MIN(section->virtual_size, section->size_of_raw_data);
+	size_t section_offset = rva - section->virtual_address;
+	if (section_offset >= data_size) {
+		return NULL;
+	}
+
+	uint8_t *contents = load_section_contents(pe, section);
+	if (!contents) {
+		return NULL;
+	}
+
+	*available = data_size - section_offset;
+	return contents + section_offset;
+}
+
+// Returns the NUL terminated string at rva and its length, or NULL when it doesn't end inside the section
+const char* rva_to_string(ppelib_file_t *pe, size_t rva, size_t *size) {
+	size_t available;
+	const uint8_t *string = rva_to_pointer(pe, rva, &available);
+
+	const uint8_t *end = string ? memchr(string, 0, available) : NULL;
+	if (!end) {
+		return NULL;
+	}
+
+	*size = end - string;
+	return (const char*)string;
+}
+
+EXPORT_SYM ppelib_section_t* ppelib_rva_to_section(ppelib_file_t *pe, size_t rva) {
+	ppelib_reset_error();
+
+	ppelib_section_t *section = section_for_rva(pe, rva);
+	if (!section) {
+		ppelib_set_error("RVA not in any section");
+	}
+
+	return section;
+}
+
+EXPORT_SYM size_t ppelib_rva_to_offset(ppelib_file_t *pe, size_t rva) {
+	ppelib_reset_error();
+
+	ppelib_section_t *section = section_for_rva(pe, rva);
+	if (!section) {
+		// The headers are mapped at their file offsets
+		if (rva < pe->header.size_of_headers) {
+			return rva;
+		}
+
+		ppelib_set_error("RVA not in any section");
+		return 0;
+	}
+
+	size_t section_offset = rva - section->virtual_address;
+	if (section_offset >= section->size_of_raw_data) {
+		ppelib_set_error("RVA not backed by file data");
+		return 0;
+	}
+
+	return section->pointer_to_raw_data + section_offset;
+}
+
+EXPORT_SYM size_t ppelib_offset_to_rva(ppelib_file_t *pe, size_t offset) {
+	ppelib_reset_error();
+
+	const ppelib_section_range_t *range = find_section_range(pe->sections_by_offset, pe->indexed_sections_by_offset,
+			offset);
+	if (!range || offset >= range->end) {
+		if (offset < pe->header.size_of_headers) {
+			return offset;
+		}
+
+		ppelib_set_error("Offset not in any section");
+		return 0;
+	}
+
+	ppelib_section_t *section = pe->sections[range->index];
+	return section->virtual_address + (offset - range->start);
+}
+
+// Reads a NUL terminated string of at most PE_MAX_LONG_NAME characters at offset of the file
+char* read_long_name(ppelib_file_t *pe, const uint8_t *buffer, size_t size, size_t offset) {
+	uint8_t name[PE_MAX_LONG_NAME + 1];
+
+	if (offset >= size || (!buffer && !pe->reader.read_at)) {
+		return NULL;
+	}
+
+	size_t length = MIN(size - offset, PE_MAX_LONG_NAME + 1);
+	if (buffer) {
+		memcpy(name, buffer + offset, length);
+	} else {
+		reader_read(pe, offset, name, length);
+		if (ppelib_error_peek()) {
+			ppelib_reset_error();
+			return NULL;
+		}
+	}
+
+	uint8_t *end = memchr(name, 0, length);
+	if (!end) {
+		return NULL;
+	}
+
+	char *retval = arena_alloc(&pe->arena, (end - name) + 1);
+	if (retval) {
+		memcpy(retval, name, (end - name) + 1);
+	}
+
+	return retval;
+}
+
+// Object style long names are "/" followed by the decimal offset of the name in the COFF string table
+const char* resolve_section_name(ppelib_file_t *pe, const ppelib_section_t *section, const uint8_t *buffer,
+		size_t size) {
+	if (section->name[0] != '/' || !section->name[1] || !pe->header.pointer_to_symbol_table) {
+		return section->name;
+	}
+
+	size_t string_offset = 0;
+	for (const char *c = section->name + 1; *c; ++c) {
+		if (*c < '0' || *c > '9') {
+			return section->name;
+		}
+
+		string_offset = (string_offset * 10) + (*c - '0');
+	}
+
+	size_t string_table = pe->header.pointer_to_symbol_table + ((size_t)pe->header.number_of_symbols * 18);
+	char *name = read_long_name(pe, buffer, size, string_table + string_offset);
+	if (!name) {
+		return section->name;
+	}
+
+	return name;
+}
+
+uint32_t section_name_hash(const char *name) {
+	uint32_t hash = 2166136261u;
+
+	for (; *name; ++name) {
+		hash = (hash ^ (uint8_t)*name) * 16777619u;
+	}
+
+	return hash;
+}
+
+// buffer holds the whole file, or is NULL when the handle reads through a reader
+void build_section_names(ppelib_file_t *pe, const uint8_t *buffer, size_t size) {
+	size_t number_of_sections = pe->header.number_of_sections;
+
+	size_t buckets = 8;
+	while (buckets < number_of_sections * 2) {
+		buckets *= 2;
+	}
+
+	pe->section_names = arena_alloc(&pe->arena, sizeof(char*) * number_of_sections);
+	pe->section_name_index = arena_calloc(&pe->arena, sizeof(uint16_t) * buckets);
+	if (!pe->section_names || !pe->section_name_index) {
+		ppelib_set_error("Failed to allocate section name index");
+		return;
+	}
+	pe->section_name_buckets = buckets;
+
+	for (uint16_t i = 0; i < number_of_sections; ++i) {
+		pe->section_names[i] = resolve_section_name(pe, pe->sections[i], buffer, size);
+
+		// Buckets hold the section index + 1. Only the first section with a given name is indexed.
+		size_t bucket = section_name_hash(pe->section_names[i]) & (buckets - 1);
+		while (pe->section_name_index[bucket]) {
+			if (strcmp(pe->section_names[pe->section_name_index[bucket] - 1], pe->section_names[i]) == 0) {
+				break;
+			}
+			bucket = (bucket + 1) & (buckets - 1);
+		}
+
+		if (!pe->section_name_index[bucket]) {
+			pe->section_name_index[bucket] = i + 1;
+		}
+	}
+}
+
+EXPORT_SYM const char* ppelib_section_get_name(ppelib_file_t *pe, uint16_t section_index) {
+	ppelib_reset_error();
+
+	if (section_index >= pe->header.number_of_sections) {
+		ppelib_set_error("Section index out of range");
+		return NULL;
+	}
+
+	return pe->section_names[section_index];
+}
+
+EXPORT_SYM ppelib_section_t* ppelib_section_find_by_name(ppelib_file_t *pe, const char *name) {
+	ppelib_reset_error();
+
+	if (pe->section_name_buckets) {
+		size_t bucket = section_name_hash(name) & (pe->section_name_buckets - 1);
+
+		while (pe->section_name_index[bucket]) {
+			uint16_t index = pe->section_name_index[bucket] - 1;
+			if (strcmp(pe->section_names[index], name) == 0) {
+				return pe->sections[index];
+			}
+
+			bucket = (bucket + 1) & (pe->section_name_buckets - 1);
+		}
+	}
+
+	ppelib_set_error("Section not found");
+	return NULL;
+}
@@ -0,0 +1,231 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-stats.h>
+
+#include "main.h"
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "utils.h"
+
+#define HISTOGRAM_LANES 4
+// Keeps the 32 bit lane counters from overflowing
+#define HISTOGRAM_CHUNK_SIZE ((size_t)1 << 30)
+
+// Incrementing a single table stalls when neighbouring bytes are equal, since each increment has to wait for the
+// store of the previous one. Spreading the bytes over separate tables keeps the increments independent.
+void count_bytes(const uint8_t *data, size_t size, uint64_t *histogram) {
+	uint32_t lanes[HISTOGRAM_LANES][256];
+
+	while (size) {
+		size_t chunk = MIN(size, HISTOGRAM_CHUNK_SIZE);
+		memset(lanes, 0, sizeof(lanes));
+
+		size_t i = 0;
+		for (; i + 8 <= chunk; i += 8) {
+			uint64_t word = read_uint64_t(data + i);
+
+			lanes[0][word & 0xFF]++;
+			lanes[1][(word >> 8) & 0xFF]++;
+			lanes[2][(word >> 16) & 0xFF]++;
+			lanes[3][(word >> 24) & 0xFF]++;
+			lanes[0][(word >> 32) & 0xFF]++;
+			lanes[1][(word >> 40) & 0xFF]++;
+			lanes[2][(word >> 48) & 0xFF]++;
+			lanes[3][word >> 56]++;
+		}
+
+		for (; i < chunk; ++i) {
+			lanes[0][data[i]]++;
+		}
+
+		for (size_t b = 0; b < 256; ++b) {
+			histogram[b] += (uint64_t)lanes[0][b] + lanes[1][b] + lanes[2][b] + lanes[3][b];
+		}
+
+		data += chunk;
+		size -= chunk;
+	}
+}
+
+void finish_byte_stats(ppelib_byte_stats_t *stats) {
+	stats->entropy = 0;
+	stats->chi_square = 0;
+
+	if (!stats->size) {
+		return;
+	}
+
+	double size = (double)stats->size;
+	double expected = size / 256;
+
+	for (size_t b = 0; b < 256; ++b) {
+		double count = (double)stats->histogram[b];
+		if (count) {
+			double p = count / size;
+			stats->entropy -= p * log2(p);
+		}
+
+		stats->chi_square += ((count - expected) * (count - expected)) / expected;
+	}
+}
+
+// Returns the cached stats for index, or NULL with entry set to the slot to fill in
+ppelib_byte_stats_t* cached_stats(ppelib_file_t *pe, ppelib_stats_cache_t *cache, size_t number_of_entries,
+		size_t index, ppelib_byte_stats_t **entry) {
+	if (cache->number_of_entries != number_of_entries) {
+		cache->stats = arena_alloc(&pe->arena, sizeof(ppelib_byte_stats_t) * number_of_entries);
+		cache->valid = arena_calloc(&pe->arena, number_of_entries);
+		if (!cache->stats || !cache->valid) {
+			ppelib_set_error("Failed to allocate stats cache");
+			memset(cache, 0, sizeof(ppelib_stats_cache_t));
+			return NULL;
+		}
+
+		cache->number_of_entries = number_of_entries;
+	}
+
+	*entry = &cache->stats[index];
+	return cache->valid[index] ? &cache->stats[index] : NULL;
+}
+
+void invalidate_stats(ppelib_stats_cache_t *cache) {
+	if (cache->valid) {
+		memset(cache->valid, 0, cache->number_of_entries);
+	}
+}
+
+const ppelib_byte_stats_t* section_stats(ppelib_file_t *pe, uint16_t section_index) {
+	if (section_index >= pe->header.number_of_sections) {
+		ppelib_set_error("Section index out of range");
+		return NULL;
+	}
+
+	ppelib_byte_stats_t *stats = NULL;
+	ppelib_byte_stats_t *cached = cached_stats(pe, &pe->section_stats, pe->header.number_of_sections, section_index,
+			&stats);
+	if (cached || ppelib_error_peek()) {
+		return cached;
+	}
+
+	ppelib_section_t *section = pe->sections[section_index];
+	const uint8_t *contents = load_section_contents(pe, section);
+	if (ppelib_error_peek()) {
+		return NULL;
+	}
+
+	// The section as it is written, the writer pads the contents with zeroes up to the raw size
+	size_t data_size = contents ? MIN(section->virtual_size, section->size_of_raw_data) : 0;
+
+	memset(stats, 0, sizeof(ppelib_byte_stats_t));
+	stats->size = section->size_of_raw_data;
+	count_bytes(contents, data_size, stats->histogram);
+	stats->histogram[0] += section->size_of_raw_data - data_size;
+	finish_byte_stats(stats);
+
+	pe->section_stats.valid[section_index] = 1;
+	return stats;
+}
+
+const ppelib_byte_stats_t* overlay_stats(ppelib_file_t *pe) {
+	ppelib_byte_stats_t *stats = NULL;
+	ppelib_byte_stats_t *cached = cached_stats(pe, &pe->overlay_stats, 1, 0, &stats);
+	if (cached || ppelib_error_peek()) {
+		return cached;
+	}
+
+	const uint8_t *trailing_data = load_trailing_data(pe);
+	if (ppelib_error_peek()) {
+		return NULL;
+	}
+
+	memset(stats, 0, sizeof(ppelib_byte_stats_t));
+	stats->size = pe->trailing_data_size;
+	count_bytes(trailing_data, pe->trailing_data_size, stats->histogram);
+	finish_byte_stats(stats);
+
+	pe->overlay_stats.valid[0] = 1;
+	return stats;
+}
+
+const ppelib_byte_stats_t* resource_stats(ppelib_file_t *pe, const ppelib_resource_entry_t *entry) {
+	if (!load_resource_index(pe)) {
+		return NULL;
+	}
+
+	if (entry < pe->resources || entry >= pe->resources + pe->number_of_resources) {
+		ppelib_set_error("Not a resource entry of this handle");
+		return NULL;
+	}
+
+	size_t index = entry - pe->resources;
+
+	ppelib_byte_stats_t *stats = NULL;
+	ppelib_byte_stats_t *cached = cached_stats(pe, &pe->resource_stats, pe->number_of_resources, index, &stats);
+	if (cached || ppelib_error_peek()) {
+		return cached;
+	}
+
+	const ppelib_resource_data_t *data = entry->data;
+
+	memset(stats, 0, sizeof(ppelib_byte_stats_t));
+	if (data->data) {
+		stats->size = data->size;
+		count_bytes(data->data, data->size, stats->histogram);
+	}
+	finish_byte_stats(stats);
+
+	pe->resource_stats.valid[index] = 1;
+	return stats;
+}
+
+// The caches are filled in under the handle lock, so the stats can be asked for from several threads
+EXPORT_SYM const ppelib_byte_stats_t* ppelib_section_stats(ppelib_file_t *pe, uint16_t section_index) {
+	ppelib_reset_error();
+
+	lock_file(pe);
+	const ppelib_byte_stats_t *stats = section_stats(pe, section_index);
+	unlock_file(pe);
+
+	return stats;
+}
+
+EXPORT_SYM const ppelib_byte_stats_t* ppelib_overlay_stats(ppelib_file_t *pe) {
+	ppelib_reset_error();
+
+	lock_file(pe);
+	const ppelib_byte_stats_t *stats = overlay_stats(pe);
+	unlock_file(pe);
+
+	return stats;
+}
+
+EXPORT_SYM const ppelib_byte_stats_t* ppelib_resource_stats(ppelib_file_t *pe, const ppelib_resource_entry_t *entry) {
+	ppelib_reset_error();
+
+	lock_file(pe);
+	const ppelib_byte_stats_t *stats = resource_stats(pe, entry);
+	unlock_file(pe);
+
+	return stats;
+}
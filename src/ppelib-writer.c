@@ -0,0 +1,609 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <ppelib/ppelib-constants.h>
+#include <ppelib/ppelib-sink.h>
+
+#include "ppelib-error.h"
+#include "ppelib-internal.h"
+#include "export.h"
+#include "main.h"
+
+#define WRITER_READ_BUFFER_SIZE (64 * 1024)
+
+typedef struct emitter {
+	const ppelib_sink_t *sink;
+
+	size_t offset;
+	size_t size;
+	const uint8_t *data;
+} emitter_t;
+
+size_t image_size(ppelib_file_t *pe, image_layout_t *layout) {
+	size_t size = 0;
+
+	size += pe->pe_header_offset;
+	size += 4;
+	size_t coff_header_size = serialize_pe_header(&pe->header, NULL, pe->pe_header_offset);
+	if (ppelib_error_peek()) {
+		return 0;
+	}
+
+	size += coff_header_size;
+	size_t end_of_sections = 0;
+
+	size_t section_offset = pe->pe_header_offset + coff_header_size;
+	for (uint32_t i = 0; i < pe->header.number_of_sections; ++i) {
+		size_t section_size = serialize_section(pe->sections[i], NULL, section_offset + (i * PE_SECTION_HEADER_SIZE));
+		if (ppelib_error_peek()) {
+			return 0;
+		}
+
+		if (section_size > end_of_sections) {
+			end_of_sections = section_size;
+		}
+	}
+
+	// Theoretically all the sections could be before the header
+	if (end_of_sections > size) {
+		size = end_of_sections;
+	}
+
+	size += pe->trailing_data_size;
+
+	// Until it is parsed the certificate table is empty and its contents are part of the trailing data
+	uint8_t certificates_parsed = atomic_load_explicit(&pe->certificate_table_parsed, memory_order_acquire);
+
+	size_t certificates_size = 0;
+	if (certificates_parsed && pe->header.number_of_rva_and_sizes > DIR_CERTIFICATE_TABLE) {
+		if (pe->header.data_directories[DIR_CERTIFICATE_TABLE].size) {
+			certificates_size = serialize_certificate_table(&pe->certificate_table, NULL);
+			if (ppelib_error_peek()) {
+				return 0;
+			}
+
+			if (certificates_size > size) {
+				size = certificates_size;
+			}
+		}
+	}
+
+	if (layout) {
+		layout->size = size;
+		layout->end_of_sections = end_of_sections;
+		layout->section_offset = section_offset;
+		layout->certificates_parsed = certificates_parsed;
+	}
+
+	return size;
+}
+
+void add_extent(image_layout_t *layout, size_t offset, size_t size, const uint8_t *data, size_t source) {
+	if (!size || offset >= layout->size) {
+		return;
+	}
+
+	image_extent_t *extent = &layout->extents[layout->number_of_extents];
+	extent->offset = offset;
+	extent->size = MIN(size, layout->size - offset);
+	extent->priority = layout->number_of_extents;
+	extent->data = data;
+	extent->source = source;
+
+	layout->number_of_extents++;
+}
+
+void free_image_layout(const ppelib_file_t *pe, image_layout_t *layout) {
+	mem_free(pe, layout->extents);
+	mem_free(pe, layout->headers);
+	mem_free(pe, layout->certificate_headers);
+}
+
+size_t image_headers_size(const ppelib_file_t *pe, size_t section_offset) {
+	return section_offset + 4 + (pe->header.number_of_sections * PE_SECTION_HEADER_SIZE) - pe->pe_header_offset;
+}
+
+// Serializes everything from the PE signature up to the end of the section table into headers, which must hold
+// image_headers_size() bytes
+void write_image_headers(ppelib_file_t *pe, size_t section_offset, uint8_t *headers) {
+	memset(headers, 0, image_headers_size(pe, section_offset));
+
+	memcpy(headers, "PE\0", 4);
+	serialize_pe_header(&pe->header, headers, 4);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < pe->header.number_of_sections; ++i) {
+		size_t header_offset = section_offset + 4 + (i * PE_SECTION_HEADER_SIZE) - pe->pe_header_offset;
+		serialize_section_header(pe->sections[i], headers + header_offset);
+	}
+}
+
+uint8_t* serialize_image_headers(ppelib_file_t *pe, size_t section_offset, size_t *size) {
+	size_t headers_size = image_headers_size(pe, section_offset);
+
+	uint8_t *headers = mem_alloc(pe, headers_size);
+	if (!headers) {
+		ppelib_set_error("Failed to allocate headers");
+		return NULL;
+	}
+
+	write_image_headers(pe, section_offset, headers);
+	if (ppelib_error_peek()) {
+		mem_free(pe, headers);
+		return NULL;
+	}
+
+	*size = headers_size;
+	return headers;
+}
+
+void build_image_layout(ppelib_file_t *pe, image_layout_t *layout) {
+	memset(layout, 0, sizeof(image_layout_t));
+
+	image_size(pe, layout);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	size_t certificates = 0;
+	if (layout->certificates_parsed && pe->header.number_of_rva_and_sizes > DIR_CERTIFICATE_TABLE) {
+		if (pe->header.data_directories[DIR_CERTIFICATE_TABLE].size) {
+			certificates = pe->certificate_table.size;
+		}
+	}
+
+	size_t max_extents = 2 + (pe->header.number_of_sections * 2) + 1 + (certificates * 2);
+	layout->extents = mem_alloc(pe, sizeof(image_extent_t) * max_extents);
+	if (!layout->extents) {
+		ppelib_set_error("Failed to allocate image layout");
+		return;
+	}
+
+	size_t headers_start = pe->pe_header_offset;
+	size_t headers_size = 0;
+
+	layout->headers = serialize_image_headers(pe, layout->section_offset, &headers_size);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	add_extent(layout, 0, pe->pe_header_offset, pe->stub, 0);
+	add_extent(layout, headers_start, layout->section_offset + 4 - headers_start, layout->headers, 0);
+
+	for (uint32_t i = 0; i < pe->header.number_of_sections; ++i) {
+		ppelib_section_t *section = pe->sections[i];
+		size_t header_offset = layout->section_offset + 4 + (i * PE_SECTION_HEADER_SIZE);
+
+		add_extent(layout, header_offset, PE_SECTION_HEADER_SIZE, layout->headers + header_offset - headers_start, 0);
+
+		size_t data_size = MIN(section->virtual_size, section->size_of_raw_data);
+		if (data_size && !section->contents && !pe->reader.read_at) {
+			ppelib_set_error("Section contents missing");
+			return;
+		}
+
+		add_extent(layout, section->pointer_to_raw_data, data_size, section->contents, section->pointer_to_raw_data);
+	}
+
+	if (pe->trailing_data_size && !pe->trailing_data && !pe->reader.read_at) {
+		ppelib_set_error("Trailing data missing");
+		return;
+	}
+
+	// Unloaded trailing data still sits at the original end of sections in the source file
+	add_extent(layout, layout->end_of_sections, pe->trailing_data_size, pe->trailing_data, pe->end_of_sections);
+
+	if (certificates) {
+		layout->certificate_headers = mem_alloc(pe, certificates * 8);
+		if (!layout->certificate_headers) {
+			ppelib_set_error("Failed to allocate certificate headers");
+			return;
+		}
+
+		size_t offset = pe->certificate_table.offset;
+		for (size_t i = 0; i < certificates; ++i) {
+			const ppelib_certificate_t *certificate = &pe->certificate_table.certificates[i];
+			uint8_t *header = layout->certificate_headers + (i * 8);
+
+			serialize_certificate_header(certificate, header);
+			add_extent(layout, offset, 8, header, 0);
+			add_extent(layout, offset + 8, certificate->length - 8, certificate->certificate, 0);
+
+			offset = TO_NEAREST(offset + certificate->length, 8);
+		}
+	}
+}
+
+void emit_flush(emitter_t *emitter) {
+	if (!emitter->size) {
+		return;
+	}
+
+	size_t written = emitter->sink->write(emitter->sink->context, emitter->offset, emitter->data, emitter->size);
+	if (written != emitter->size) {
+		ppelib_set_error("Failed to write data");
+	}
+
+	emitter->offset += emitter->size;
+	emitter->size = 0;
+	emitter->data = NULL;
+}
+
+// Queues a range, merging it with the previous one where possible. data is NULL for zeroes.
+void emit(emitter_t *emitter, const uint8_t *data, size_t size) {
+	if (emitter->size) {
+		uint8_t zeroes = !data && !emitter->data;
+		uint8_t adjacent = data && emitter->data && data == emitter->data + emitter->size;
+
+		if (!zeroes && !adjacent) {
+			emit_flush(emitter);
+			if (ppelib_error_peek()) {
+				return;
+			}
+		}
+	}
+
+	if (!emitter->size) {
+		emitter->data = data;
+	}
+	emitter->size += size;
+}
+
+void emit_from_reader(emitter_t *emitter, ppelib_file_t *pe, size_t source, size_t size, uint8_t **read_buffer) {
+	emit_flush(emitter);
+	if (ppelib_error_peek()) {
+		return;
+	}
+
+	if (!*read_buffer) {
+		*read_buffer = mem_alloc(pe, WRITER_READ_BUFFER_SIZE);
+		if (!*read_buffer) {
+			ppelib_set_error("Failed to allocate read buffer");
+			return;
+		}
+	}
+
+	while (size) {
+		size_t chunk = MIN(size, WRITER_READ_BUFFER_SIZE);
+
+		reader_read(pe, source, *read_buffer, chunk);
+		if (ppelib_error_peek()) {
+			return;
+		}
+
+		emit(emitter, *read_buffer, chunk);
+		emit_flush(emitter);
+		if (ppelib_error_peek()) {
+			return;
+		}
+
+		source += chunk;
+		size -= chunk;
+	}
+}
+
+int compare_extents(const void *a, const void *b) {
+	const image_extent_t *ea = a;
+	const image_extent_t *eb = b;
+
+	if (ea->offset != eb->offset) {
+		return ea->offset < eb->offset ? -1 : 1;
+	}
+
+	return ea->priority < eb->priority ? -1 : 1;
+}
+
+int compare_offsets(const void *a, const void *b) {
+	size_t oa = *(const size_t*)a;
+	size_t ob = *(const size_t*)b;
+
+	if (oa == ob) {
+		return 0;
+	}
+
+	return oa < ob ? -1 : 1;
+}
+
+void extent_heap_push(image_extent_t **heap, size_t *heap_size, image_extent_t *extent) {
+	size_t i = (*heap_size)++;
+	heap[i] = extent;
+
+	while (i && heap[(i - 1) / 2]->priority < heap[i]->priority) {
+		image_extent_t *t = heap[i];
+		heap[i] = heap[(i - 1) / 2];
+		heap[(i - 1) / 2] = t;
+		i = (i - 1) / 2;
+	}
+}
+
+void extent_heap_pop(image_extent_t **heap, size_t *heap_size) {
+	heap[0] = heap[--(*heap_size)];
+
+	size_t i = 0;
+	while (1) {
+		size_t largest = i;
+		size_t left = (i * 2) + 1;
+		size_t right = (i * 2) + 2;
+
+		if (left < *heap_size && heap[left]->priority > heap[largest]->priority) {
+			largest = left;
+		}
+		if (right < *heap_size && heap[right]->priority > heap[largest]->priority) {
+			largest = right;
+		}
+		if (largest == i) {
+			break;
+		}
+
+		image_extent_t *t = heap[i];
+		heap[i] = heap[largest];
+		heap[largest] = t;
+		i = largest;
+	}
+}
+
+// Walks the image in file order. Every range is taken from the highest priority extent covering it, ranges not
+// covered by any extent are zeroes.
+void emit_image_layout(ppelib_file_t *pe, image_layout_t *layout, const ppelib_sink_t *sink) {
+	size_t number_of_extents = layout->number_of_extents;
+	image_extent_t *extents = layout->extents;
+
+	qsort(extents, number_of_extents, sizeof(image_extent_t), compare_extents);
+
+	size_t number_of_points = 0;
+	size_t *points = mem_alloc(pe, sizeof(size_t) * ((number_of_extents * 2) + 1));
+	image_extent_t **heap = mem_alloc(pe, sizeof(image_extent_t*) * (number_of_extents + 1));
+	if (!points || !heap) {
+		mem_free(pe, points);
+		mem_free(pe, heap);
+		ppelib_set_error("Failed to allocate image layout");
+		return;
+	}
+
+	for (size_t i = 0; i < number_of_extents; ++i) {
+		points[number_of_points++] = extents[i].offset;
+		points[number_of_points++] = extents[i].offset + extents[i].size;
+	}
+	points[number_of_points++] = layout->size;
+	qsort(points, number_of_points, sizeof(size_t), compare_offsets);
+
+	emitter_t emitter = { 0 };
+	emitter.sink = sink;
+
+	uint8_t *read_buffer = NULL;
+	size_t heap_size = 0;
+	size_t next_extent = 0;
+	size_t position = 0;
+
+	for (size_t p = 0; p < number_of_points && !ppelib_error_peek(); ++p) {
+		size_t end = points[p];
+		if (end <= position) {
+			continue;
+		}
+
+		while (next_extent < number_of_extents && extents[next_extent].offset <= position) {
+			extent_heap_push(heap, &heap_size, &extents[next_extent]);
+			next_extent++;
+		}
+
+		while (heap_size && heap[0]->offset + heap[0]->size <= position) {
+			extent_heap_pop(heap, &heap_size);
+		}
+
+		if (!heap_size) {
+			emit(&emitter, NULL, end - position);
+		} else if (heap[0]->data) {
+			emit(&emitter, heap[0]->data + (position - heap[0]->offset), end - position);
+		} else {
+			emit_from_reader(&emitter, pe, heap[0]->source + (position - heap[0]->offset), end - position,
+					&read_buffer);
+		}
+
+		position = end;
+	}
+
+	if (!ppelib_error_peek()) {
+		emit_flush(&emitter);
+	}
+
+	mem_free(pe, read_buffer);
+	mem_free(pe, points);
+	mem_free(pe, heap);
+}
+
+// Fails without writing anything when the image is larger than max_size. The size is checked against the layout that
+// is written, another thread parsing the certificate table can change the size between two layouts.
+size_t write_image_bounded(ppelib_file_t *pe, const ppelib_sink_t *sink, size_t max_size) {
+	image_layout_t layout;
+
+	// Reader handles may be loading contents on another thread while the layout refers to them
+	if (pe->reader.read_at) {
+		lock_file(pe);
+	}
+
+	build_image_layout(pe, &layout);
+	if (!ppelib_error_peek() && layout.size > max_size) {
+		ppelib_set_error("Target buffer too small.");
+	}
+
+	if (!ppelib_error_peek()) {
+		emit_image_layout(pe, &layout, sink);
+	}
+
+	if (pe->reader.read_at) {
+		unlock_file(pe);
+	}
+
+	free_image_layout(pe, &layout);
+
+	if (ppelib_error_peek()) {
+		return 0;
+	}
+
+	return layout.size;
+}
+
+size_t write_image(ppelib_file_t *pe, const ppelib_sink_t *sink) {
+	return write_image_bounded(pe, sink, SIZE_MAX);
+}
+
+size_t buffer_sink_write(void *context, size_t offset, const uint8_t *data, size_t size) {
+	uint8_t *buffer = context;
+
+	if (data) {
+		memcpy(buffer + offset, data, size);
+	} else {
+		memset(buffer + offset, 0, size);
+	}
+
+	return size;
+}
+
+#ifndef _WIN32
+size_t fd_sink_write(void *context, size_t offset, const uint8_t *data, size_t size) {
+	int fd = *(int*)context;
+
+	// The file is truncated to its final size afterwards, so zeroes don't need to be written at all
+	if (!data) {
+		return size;
+	}
+
+	size_t written = 0;
+	while (written < size) {
+		ssize_t retsize = pwrite(fd, data + written, size - written, offset + written);
+		if (retsize <= 0) {
+			return written;
+		}
+		written += retsize;
+	}
+
+	return written;
+}
+#else
+size_t file_sink_write(void *context, size_t offset, const uint8_t *data, size_t size) {
+	static const uint8_t zeroes[4096];
+	FILE *f = context;
+
+	if (data) {
+		return fwrite(data, 1, size, f);
+	}
+
+	size_t written = 0;
+	while (written < size) {
+		size_t chunk = MIN(size - written, sizeof(zeroes));
+		size_t retsize = fwrite(zeroes, 1, chunk, f);
+		written += retsize;
+
+		if (retsize != chunk) {
+			break;
+		}
+	}
+
+	return written;
+}
+#endif
+
+EXPORT_SYM size_t ppelib_write_to_sink(ppelib_file_t *pe, const ppelib_sink_t *sink) {
+	ppelib_reset_error();
+
+	return write_image(pe, sink);
+}
+
+EXPORT_SYM size_t ppelib_write_to_buffer(ppelib_file_t *pe, uint8_t *buffer, size_t buf_size) {
+	ppelib_reset_error();
+
+	if (!buffer) {
+		return image_size(pe, NULL);
+	}
+
+	ppelib_sink_t sink = { buffer_sink_write, buffer };
+	return write_image_bounded(pe, &sink, buf_size);
+}
+
+#ifndef _WIN32
+// Writes the image from the start of the file, cuts the file off after it and closes fd
+size_t write_image_to_fd(ppelib_file_t *pe, int fd) {
+	ppelib_sink_t sink = { fd_sink_write, &fd };
+	size_t written = write_image(pe, &sink);
+
+	if (!ppelib_error_peek() && ftruncate(fd, written)) {
+		ppelib_set_error("Failed to write data");
+		written = 0;
+	}
+
+	if (close(fd) && !ppelib_error_peek()) {
+		ppelib_set_error("Failed to write data");
+		written = 0;
+	}
+
+	return written;
+}
+#endif
+
+// Opens filename, truncating it, and writes the image into it
+size_t write_file(ppelib_file_t *pe, const char *filename) {
+#ifndef _WIN32
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		ppelib_set_error("Failed to open file");
+		return 0;
+	}
+
+	size_t written = write_image_to_fd(pe, fd);
+#else
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		ppelib_set_error("Failed to open file");
+		return 0;
+	}
+
+	ppelib_sink_t sink = { file_sink_write, f };
+	size_t written = write_image(pe, &sink);
+
+	fclose(f);
+#endif
+
+	return written;
+}
+
+EXPORT_SYM size_t ppelib_write_to_file(ppelib_file_t *pe, const char *filename) {
+	ppelib_reset_error();
+
+	// The handle may still read from the file it is written to, which must not be truncated underneath it
+	if ((pe->file_buffer && !pe->file_buffer_owned) || pe->reader.read_at) {
+		return write_replacement(pe, filename);
+	}
+
+	return write_file(pe, filename);
+}
@@ -24,6 +24,7 @@
 #include <ppelib/ppelib-constants.h>
 
 #define HIGH_BIT32 ((uint32_t)(1) << 31)
+#define HIGH_BIT64 ((uint64_t)(1) << 63)
 #define CHECK_BIT(var,val) ((var) & (val))
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 #define MAX(X ,Y) (((X) > (Y)) ? (X) : (Y))
@@ -39,8 +40,6 @@ void write_uint32_t(uint8_t* buffer, uint32_t val);
 uint64_t read_uint64_t(const uint8_t* buffer);
 void write_uint64_t(uint8_t* buffer, uint64_t val);
 
-uint16_t buffer_excise(uint8_t** buffer, size_t size, size_t start, size_t end);
-
 const char* map_lookup(uint32_t value, const ppelib_map_entry_t* map);
 
 #endif /* PPELIB_UTILS_H */
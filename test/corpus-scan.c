@@ -0,0 +1,410 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ppelib/ppelib.h>
+#include <ppelib/ppelib-low-level.h>
+
+#define ERROR_SIZE 100
+#define MAX_ERROR_CLASSES 64
+
+typedef struct file_result {
+	size_t size;
+	// Only set for files that were read and handed to ppelib
+	uint8_t timed;
+	uint64_t latency;
+	char error[ERROR_SIZE];
+} file_result_t;
+
+typedef struct file_list {
+	size_t number_of_files;
+	size_t allocated_files;
+	char **files;
+} file_list_t;
+
+typedef struct scan {
+	const file_list_t *list;
+	file_result_t *results;
+	atomic_size_t next_file;
+} scan_t;
+
+typedef struct error_class {
+	const char *error;
+	size_t count;
+} error_class_t;
+
+uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+int add_file(file_list_t *list, const char *path) {
+	if (list->number_of_files == list->allocated_files) {
+		size_t allocated = list->allocated_files ? list->allocated_files * 2 : 1024;
+		char **files = realloc(list->files, sizeof(char*) * allocated);
+		if (!files) {
+			return 0;
+		}
+
+		list->files = files;
+		list->allocated_files = allocated;
+	}
+
+	list->files[list->number_of_files] = strdup(path);
+	if (!list->files[list->number_of_files]) {
+		return 0;
+	}
+
+	list->number_of_files++;
+	return 1;
+}
+
+// Symlinked directories are not followed, so the walk can't loop
+int add_path(file_list_t *list, const char *path) {
+	struct stat st;
+	if (lstat(path, &st) != 0) {
+		fprintf(stderr, "Can't stat %s\n", path);
+		return 1;
+	}
+
+	if (S_ISLNK(st.st_mode) && (stat(path, &st) != 0 || S_ISDIR(st.st_mode))) {
+		return 1;
+	}
+
+	if (S_ISREG(st.st_mode)) {
+		return add_file(list, path);
+	}
+
+	if (!S_ISDIR(st.st_mode)) {
+		return 1;
+	}
+
+	DIR *dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "Can't open directory %s\n", path);
+		return 1;
+	}
+
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+			continue;
+		}
+
+		size_t size = strlen(path) + strlen(entry->d_name) + 2;
+		char *child = malloc(size);
+		if (!child) {
+			closedir(dir);
+			return 0;
+		}
+
+		snprintf(child, size, "%s/%s", path, entry->d_name);
+		int retval = add_path(list, child);
+		free(child);
+
+		if (!retval) {
+			closedir(dir);
+			return 0;
+		}
+	}
+
+	closedir(dir);
+	return 1;
+}
+
+int add_file_list(file_list_t *list, const char *filename) {
+	FILE *f = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+	if (!f) {
+		fprintf(stderr, "Can't open file list %s\n", filename);
+		return 0;
+	}
+
+	char line[4096];
+	int retval = 1;
+	while (retval && fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0]) {
+			retval = add_path(list, line);
+		}
+	}
+
+	if (f != stdin) {
+		fclose(f);
+	}
+
+	return retval;
+}
+
+// Loads every file into the same handle and buffer, so after the first few files a worker barely allocates
+void* scan_worker(void *context) {
+	scan_t *scan = context;
+	ppelib_handle *pe = ppelib_create();
+	uint8_t *buffer = NULL;
+	size_t allocated = 0;
+
+	for (;;) {
+		size_t index = atomic_fetch_add(&scan->next_file, 1);
+		if (index >= scan->list->number_of_files) {
+			break;
+		}
+
+		file_result_t *result = &scan->results[index];
+
+		if (!pe) {
+			snprintf(result->error, ERROR_SIZE, "Can't create handle");
+			continue;
+		}
+
+		FILE *f = fopen(scan->list->files[index], "rb");
+		if (!f) {
+			snprintf(result->error, ERROR_SIZE, "Can't open file");
+			continue;
+		}
+
+		fseek(f, 0, SEEK_END);
+		long size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+
+		if (size < 0) {
+			snprintf(result->error, ERROR_SIZE, "Can't read file");
+			fclose(f);
+			continue;
+		}
+
+		if ((size_t)size > allocated) {
+			uint8_t *new_buffer = realloc(buffer, size);
+			if (!new_buffer) {
+				snprintf(result->error, ERROR_SIZE, "Out of memory");
+				fclose(f);
+				continue;
+			}
+
+			buffer = new_buffer;
+			allocated = size;
+		}
+
+		result->size = fread(buffer, 1, size, f);
+		fclose(f);
+
+		uint64_t start = now();
+
+		ppelib_load_into(pe, buffer, result->size);
+		if (!ppelib_error()) {
+			ppelib_get_import_table(pe);
+		}
+		if (!ppelib_error()) {
+			ppelib_get_export_table(pe);
+		}
+		if (!ppelib_error()) {
+			ppelib_get_relocation_table(pe);
+		}
+		if (!ppelib_error()) {
+			ppelib_get_resource_table(pe);
+		}
+
+		result->latency = now() - start;
+		result->timed = 1;
+
+		if (ppelib_error()) {
+			snprintf(result->error, ERROR_SIZE, "%s", ppelib_error());
+		}
+	}
+
+	free(buffer);
+	ppelib_destroy(pe);
+	return NULL;
+}
+
+int compare_latencies(const void *a, const void *b) {
+	uint64_t la = *(const uint64_t*)a;
+	uint64_t lb = *(const uint64_t*)b;
+
+	if (la == lb) {
+		return 0;
+	}
+
+	return la < lb ? -1 : 1;
+}
+
+void count_error(error_class_t *classes, size_t *number_of_classes, const char *error) {
+	for (size_t i = 0; i < *number_of_classes; ++i) {
+		if (strcmp(classes[i].error, error) == 0) {
+			classes[i].count++;
+			return;
+		}
+	}
+
+	if (*number_of_classes < MAX_ERROR_CLASSES) {
+		classes[*number_of_classes].error = error;
+		classes[*number_of_classes].count = 1;
+		(*number_of_classes)++;
+	}
+}
+
+void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [-j threads] [-l file_list] [-q] [path...]\n", name);
+	fprintf(stderr, "  Parses every file under the given paths and reports throughput and latency.\n");
+	fprintf(stderr, "  -j  number of worker threads, defaults to the number of CPUs\n");
+	fprintf(stderr, "  -l  read paths from a file, one per line, - for stdin\n");
+	fprintf(stderr, "  -q  only print the summary\n");
+}
+
+int main(int argc, char *argv[]) {
+	int retval = 0;
+	long number_of_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int quiet = 0;
+
+	file_list_t list = { 0 };
+	file_result_t *results = NULL;
+	uint64_t *latencies = NULL;
+	pthread_t *threads = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "j:l:qh")) != -1) {
+		switch (opt) {
+		case 'j':
+			number_of_threads = strtol(optarg, NULL, 10);
+			break;
+		case 'l':
+			if (!add_file_list(&list, optarg)) {
+				retval = 1;
+				goto out;
+			}
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			usage(argv[0]);
+			retval = 1;
+			goto out;
+		}
+	}
+
+	for (int i = optind; i < argc; ++i) {
+		if (!add_path(&list, argv[i])) {
+			fprintf(stderr, "Out of memory\n");
+			retval = 1;
+			goto out;
+		}
+	}
+
+	if (!list.number_of_files || number_of_threads < 1) {
+		usage(argv[0]);
+		retval = 1;
+		goto out;
+	}
+
+	results = calloc(list.number_of_files, sizeof(file_result_t));
+	latencies = calloc(list.number_of_files, sizeof(uint64_t));
+	threads = calloc(number_of_threads, sizeof(pthread_t));
+	if (!results || !latencies || !threads) {
+		fprintf(stderr, "Out of memory\n");
+		retval = 1;
+		goto out;
+	}
+
+	scan_t scan = { 0 };
+	scan.list = &list;
+	scan.results = results;
+	atomic_init(&scan.next_file, 0);
+
+	uint64_t start = now();
+
+	long started = 0;
+	for (; started < number_of_threads; ++started) {
+		if (pthread_create(&threads[started], NULL, scan_worker, &scan) != 0) {
+			break;
+		}
+	}
+
+	// With no threads at all the main thread does the work
+	if (!started) {
+		scan_worker(&scan);
+	}
+
+	for (long i = 0; i < started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	uint64_t elapsed = now() - start;
+
+	size_t total_bytes = 0;
+	size_t failed = 0;
+	size_t timed = 0;
+	error_class_t classes[MAX_ERROR_CLASSES];
+	size_t number_of_classes = 0;
+
+	for (size_t i = 0; i < list.number_of_files; ++i) {
+		const file_result_t *result = &results[i];
+
+		if (!quiet) {
+			printf("%s\t%zu\t%.1f\t%s\n", list.files[i], result->size, result->latency / 1000.0,
+					result->error[0] ? result->error : "OK");
+		}
+
+		total_bytes += result->size;
+		// Files that couldn't be read would pull the percentiles down
+		if (result->timed) {
+			latencies[timed++] = result->latency;
+		}
+
+		if (result->error[0]) {
+			failed++;
+			count_error(classes, &number_of_classes, result->error);
+		}
+	}
+
+	qsort(latencies, timed, sizeof(uint64_t), compare_latencies);
+
+	double seconds = elapsed / 1e9;
+	printf("\n");
+	printf("Files:        %zu (%zu failed) with %ld threads\n", list.number_of_files, failed, started ? started : 1);
+	printf("Time:         %.3f s\n", seconds);
+	printf("Throughput:   %.1f files/s, %.1f MB/s\n", list.number_of_files / seconds, total_bytes / seconds / 1e6);
+	if (timed) {
+		printf("Latency p50:  %.1f us\n", latencies[timed / 2] / 1000.0);
+		printf("Latency p99:  %.1f us\n", latencies[(timed * 99) / 100] / 1000.0);
+	}
+
+	for (size_t i = 0; i < number_of_classes; ++i) {
+		printf("Error:        %zu x %s\n", classes[i].count, classes[i].error);
+	}
+
+	out:
+	for (size_t i = 0; i < list.number_of_files; ++i) {
+		free(list.files[i]);
+	}
+	free(list.files);
+	free(results);
+	free(latencies);
+	free(threads);
+
+	return retval;
+}
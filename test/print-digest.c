@@ -0,0 +1,74 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ppelib/ppelib.h>
+#include <ppelib/ppelib-low-level.h>
+
+void print_digest(const char *label, const uint8_t *digest, size_t size) {
+	printf("%s", label);
+	for (size_t i = 0; i < size; ++i) {
+		printf("%02x", digest[i]);
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+	int retval = 0;
+
+	if (argc < 2) {
+		printf("Usage: %s file\n", argv[0]);
+		return (1);
+	}
+
+	// Mapped, so the digest of the file as it is can be computed as well as that of the image as written
+	ppelib_handle *pe = ppelib_create_from_file_mapped(argv[1]);
+	if (ppelib_error()) {
+		printf("PElib-error: %s\n", ppelib_error());
+		return (1);
+	}
+
+	uint8_t digest[PPELIB_MAX_DIGEST_SIZE];
+
+	size_t size = ppelib_authenticode_digest_original(pe, PPELIB_DIGEST_SHA1, digest);
+	if (!ppelib_error()) {
+		print_digest("File SHA-1:     ", digest, size);
+		size = ppelib_authenticode_digest_original(pe, PPELIB_DIGEST_SHA256, digest);
+	}
+	if (!ppelib_error()) {
+		print_digest("File SHA-256:   ", digest, size);
+		size = ppelib_authenticode_digest(pe, PPELIB_DIGEST_SHA1, digest);
+	}
+	if (!ppelib_error()) {
+		print_digest("Image SHA-1:    ", digest, size);
+		size = ppelib_authenticode_digest(pe, PPELIB_DIGEST_SHA256, digest);
+	}
+	if (!ppelib_error()) {
+		print_digest("Image SHA-256:  ", digest, size);
+	}
+
+	if (ppelib_error()) {
+		printf("PElib-error: %s\n", ppelib_error());
+		retval = 1;
+	}
+
+	ppelib_destroy(pe);
+
+	return retval;
+}
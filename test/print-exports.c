@@ -0,0 +1,71 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ppelib/ppelib.h>
+#include <ppelib/ppelib-low-level.h>
+
+int main(int argc, char *argv[]) {
+	int retval = 0;
+
+	if (argc < 2) {
+		printf("Usage: %s file\n", argv[0]);
+		return (1);
+	}
+
+	ppelib_handle *pe = ppelib_create_from_file(argv[1]);
+	if (ppelib_error()) {
+		printf("PElib-error: %s\n", ppelib_error());
+		return (1);
+	}
+
+	ppelib_export_table_t *table = ppelib_get_export_table(pe);
+	if (ppelib_error()) {
+		printf("PElib-error: %s\n", ppelib_error());
+		ppelib_destroy(pe);
+		return (1);
+	}
+
+	printf("%s %u.%u: %zu addresses, %zu names, ordinal base %u\n", table->name ? table->name : "(unnamed)",
+			table->major_version, table->minor_version, table->number_of_addresses, table->number_of_names,
+			table->ordinal_base);
+
+	for (size_t i = 0; i < table->number_of_addresses; ++i) {
+		if (!table->addresses[i]) {
+			continue;
+		}
+
+		ppelib_export_t export = ppelib_export_find_by_ordinal(pe, table->ordinal_base + (uint32_t)i);
+		if (ppelib_error()) {
+			printf("PElib-error: %s\n", ppelib_error());
+			retval = 1;
+			break;
+		}
+
+		printf("\t%u 0x%08x %s", export.ordinal, export.address, export.name ? export.name : "(by ordinal)");
+		if (export.forwarder) {
+			printf(" -> %s", export.forwarder);
+		}
+		printf("\n");
+	}
+
+	ppelib_destroy(pe);
+
+	return retval;
+}
@@ -0,0 +1,63 @@
+/* Copyright 2021 Hein-Pieter van Braam-Stewart
+ *
+ * This file is part of ppelib (Portable Portable Executable LIBrary)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ppelib/ppelib.h>
+#include <ppelib/ppelib-low-level.h>
+
+int main(int argc, char *argv[]) {
+	int retval = 0;
+
+	if (argc < 2) {
+		printf("Usage: %s file\n", argv[0]);
+		return (1);
+	}
+
+	ppelib_handle *pe = ppelib_create_from_file(argv[1]);
+	if (ppelib_error()) {
+		printf("PElib-error: %s\n", ppelib_error());
+		return (1);
+	}
+
+	ppelib_import_table_t *table = ppelib_get_import_table(pe);
+	if (ppelib_error()) {
+		printf("PElib-error: %s\n", ppelib_error());
+		ppelib_destroy(pe);
+		return (1);
+	}
+
+	for (size_t i = 0; i < table->number_of_descriptors; ++i) {
+		const ppelib_import_descriptor_t *descriptor = &table->descriptors[i];
+		printf("%s: %zu symbols, IAT at 0x%08x\n", table->strings + descriptor->name, descriptor->number_of_symbols,
+				descriptor->first_thunk);
+
+		for (size_t j = 0; j < descriptor->number_of_symbols; ++j) {
+			const ppelib_import_symbol_t *symbol = &table->symbols[descriptor->first_symbol + j];
+			if (symbol->by_ordinal) {
+				printf("\t0x%08x ordinal %u\n", symbol->iat_rva, symbol->ordinal);
+			} else {
+				printf("\t0x%08x %s (hint %u)\n", symbol->iat_rva, table->strings + symbol->name, symbol->ordinal);
+			}
+		}
+	}
+
+	ppelib_destroy(pe);
+
+	return retval;
+}